@@ -0,0 +1,21 @@
+#define HAVE_TERMIOS_H 1
+#define HAVE_LIMITS_H 1
+#define HAVE_FCNTL_H 1
+#define HAVE_SYS_IOCTL_H 1
+#define HAVE_CFMAKERAW 1
+#define HAVE_TMPFILE 1
+#define HAVE_SIGINTERRUPT 1
+#define HAVE_FALLOC_PUNCH_HOLE 1
+#define HAVE_FTRUNCATE 1
+#define HAVE_STRUCT_STAT_ST_BLOCKS 1
+#define HAVE_POLL 1
+#define HAVE_MMAP 1
+#define _FILE_OFFSET_BITS 64
+#define HAVE_FSEEKO 1
+#define HAVE_PREAD 1
+#define HAVE_SYS_INOTIFY_H 1
+#define HAVE_PTHREAD 1
+#define HAVE_COPY_FILE_RANGE 1
+#define HAVE_SHM_OPEN 1
+#define HAVE_FSYNC 1
+#define HAVE_STRUCT_STAT_ST_MTIM 1
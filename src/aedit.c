@@ -35,6 +35,10 @@
 #	include <config.h>
 #endif
 
+#if (defined(HAVE_FALLOC_PUNCH_HOLE) || defined(HAVE_COPY_FILE_RANGE)) && !defined(_GNU_SOURCE)
+#	define _GNU_SOURCE
+#endif
+
 #ifdef HAVE_LIMITS_H
 #	include <limits.h>
 #endif
@@ -72,6 +76,102 @@
 #	include <sys/ioctl.h>
 #endif
 
+#ifdef HAVE_MMAP
+#	include <sys/mman.h>
+#endif
+
+#ifdef HAVE_POLL
+#	include <poll.h>
+#	ifdef HAVE_FTRUNCATE
+#		define SPILL_COMPACT
+#	endif
+#	define FOLLOW_FILE
+#	define FOLLOW_POLL	500
+#	define FIND_INDEX
+#	include <sys/time.h>
+#	define JOB_CANCEL
+#	define JOB_TICK	0x400
+#	define JOB_SHOW	250	/* milliseconds before progress shows */
+#	define JOB_SPAN	0x10000L
+#	define JOB_COPY	0x4000000L
+#	define ESC_DELAY	25	/* milliseconds for the rest of a key after ESC */
+#	define FRAME_MS	40	/* most time between redraws while keys wait */
+#	ifdef O_NONBLOCK
+#		define EVENT_PIPE
+#	endif
+#	ifdef HAVE_SYS_INOTIFY_H
+#		include <sys/inotify.h>
+#	endif
+#endif
+
+#if defined(HAVE_FSYNC) && !defined(_WIN32)
+#	define SAFE_WRITE	/* a new file renamed over the old one */
+#endif
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_POLL) && defined(HAVE_PREAD)
+#	include <pthread.h>
+#	define FIND_PARALLEL
+#	define FIND_THREADS	16
+#	define FIND_CHUNK	0x400000L
+#	define FIND_SLOTS	64
+#	define FIND_WIN		0x10000L
+#	define FIND_POLL	20
+#	ifdef SAFE_WRITE
+#		define SAVE_THREAD
+#		define SAVE_CHUNK	0x10000L
+#		define SAVE_POLL	250
+#	endif
+#endif
+
+#if defined(HAVE_COPY_FILE_RANGE) && defined(HAVE_PREAD)
+#	define SPAN_COPY
+#endif
+
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_MMAP) && defined(HAVE_PREAD) && defined(HAVE_FTRUNCATE)
+#	include <sys/file.h>
+#	define CLIP_SHM
+#	define CLIP_MAGIC	"aedit.c"
+#	define CLIP_DATA	64L
+#endif
+
+#ifdef TEMP_FP
+#	define UNDO_LOG
+#endif
+
+#if defined(HAVE_POLL) && defined(HAVE_FSYNC) && defined(HAVE_FTRUNCATE)
+#	include <time.h>
+#	define JOURNAL
+#	define JOURNAL_MAGIC	"aej1"
+#	define JOURNAL_SYNC	2	/* seconds */
+#endif
+
+#if defined(HAVE_FSYNC) && defined(HAVE_FTRUNCATE) && !defined(_WIN32)
+#	define DIRTY_SAVE
+#	define DIRTY_MAGIC	"aes1"
+#	define DIRTY_SEGS	65536L
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#	define FOLD_SSE2
+#endif
+
+#ifdef _WIN32
+typedef __int64 ed_off;
+#	define ed_fseek(f,o,w)	_fseeki64(f,o,w)
+#	define ed_ftell(f)		_ftelli64(f)
+#else
+#	ifdef HAVE_FSEEKO
+typedef off_t ed_off;
+#		define ed_fseek(f,o,w)	fseeko(f,o,w)
+#		define ed_ftell(f)		ftello(f)
+#	else
+typedef long ed_off;
+#		define ed_fseek(f,o,w)	fseek(f,o,w)
+#		define ed_ftell(f)		ftell(f)
+#	endif
+#endif
+
 #ifndef lint
 char sig[]="@(#)aedit 2.0";
 #endif
@@ -103,6 +203,9 @@ char sig[]="@(#)aedit 2.0";
 #	if !defined(__HAIKU__)
 #		define SCROLL_RGN
 #	endif
+#	ifdef HAVE_POLL
+#		define PASTE_WAIT	1000	/* milliseconds before a paste is taken as over */
+#	endif
 #endif
 
 #ifdef HAVE_TERMIOS_H
@@ -140,6 +243,7 @@ char sig[]="@(#)aedit 2.0";
 #define key_del		0xAC
 #define key_find	0xAD
 #define key_sel		0xAE
+#define key_grow	0x100
 
 #define ctrl_a		1
 #define ctrl_c		3
@@ -159,13 +263,114 @@ char sig[]="@(#)aedit 2.0";
 static int forever=1;
 static char f_string[max_cols];
 static char r_string[max_cols];
+static char m_string[max_cols];
+static struct
+{
+	int *next;		/* state by state and byte class, once built
+					the next row twice over, plus 1 if a
+					pattern ends there */
+	int *term;		/* the pattern a state ends, or -1 */
+	int *link;		/* the closest state down the fail chain
+					that ends a pattern, or 0 */
+	int states,size;
+	short cls[256];
+	int ncls;
+	char *text;		/* the patterns one after another */
+	char **pat;
+	long *len;
+	int npat;
+	long maxlen;
+	int c0,c1;		/* the only bytes a match can begin with */
+	char first[256];	/* the bytes a match can begin with */
+} ac;
+static int ac_hit=-1;	/* the pattern last found */
+static ed_off count_n=-1,count_lines;
+static struct
+{
+	ed_off *at;		/* where each line shown starts */
+	long n,size;
+	long top,cur;	/* the lines at the top and the cursor */
+} nv;
 static int last_cmd;
+static int view_only;
+#ifdef FOLLOW_FILE
+static int follow,follow_key,follow_fd=-1,follow_ino=-1;
+static ed_off follow_pos;
+#endif
+#ifdef FIND_PARALLEL
+static volatile int find_stop;
+#endif
+#ifdef ESC_DELAY
+static int esc_delay=ESC_DELAY;
+#endif
+#ifdef PASTE_WAIT
+static int pasting;	/* ESC [ 200 ~ came, the text follows */
+#endif
+#ifdef FRAME_MS
+static struct
+{
+	int held;		/* output is not going to the terminal */
+	struct timeval t0;	/* since when */
+} fr;
+#endif
+#ifdef JOB_CANCEL
+static char key_ahead[64];
+static int key_nahead,key_iahead;
+static struct
+{
+	char *what;		/* what is being done, 0 for no job */
+	long tick;
+	int stop;		/* ESC was typed */
+	int pct;		/* progress shown, -1 for none */
+	struct timeval t0;
+} jb={NULL,0,0,-1};
+#endif
 static char get_fname[PATH_MAX];
 
 static void find_cursor(void);
 static void ed_dump(long);
-static int ed_chr(long);
-static int ed_reserve(long);
+static int ed_chr(ed_off);
+static int ed_reserve(ed_off);
+#ifdef SPILL_COMPACT
+static void ed_cfin(void);
+static int ed_compact(void);
+#endif
+#ifdef FIND_INDEX
+static int mx_step(void);
+static void show_status(void);
+static void plot_cursor(void);
+#endif
+static ed_off ed_pos(void);
+static int get_again(int);
+#ifdef FRAME_MS
+static int fr_moves(int);
+static void fr_show(void);
+#endif
+#ifdef UNDO_LOG
+static void ud_del(ed_off,ed_off);
+static void ud_ins(ed_off,ed_off);
+#endif
+#ifdef JOURNAL
+static void jn_del(ed_off,ed_off);
+static void jn_ins(ed_off,ed_off);
+static void jn_wait(void);
+#endif
+#ifdef DIRTY_SAVE
+static void dx_del(ed_off,ed_off);
+static void dx_ins(ed_off,ed_off);
+static void dx_lose(void);
+static void dx_init(char *);
+#endif
+static int ed_fput(FILE *,ed_off,ed_off);
+#ifdef FOLLOW_FILE
+static int follow_moved(void);
+#endif
+#ifdef SAVE_THREAD
+static int sv_need(ed_off,ed_off);
+static void sv_hold(ed_off,ed_off);
+static int sv_pct(void);
+static void sv_idle(void);
+#endif
 
 static int getkey(void);
 
@@ -174,6 +379,24 @@ static int getkey(void);
 #define tty_read(x,y,z)   read(x,y,z)
 #endif /* _WIN32 */
 
+#ifdef HAVE_POLL
+static int ev_fd[2]={-1,-1};
+
+static void ev_wake(void)
+{
+	/* from a signal handler or a worker, makes ev_wait return */
+	if (ev_fd[1]!=-1)
+	{
+		int e=errno;
+		char c=0;
+
+		write(ev_fd[1],&c,1);
+
+		errno=e;
+	}
+}
+#endif
+
 int winched;
 void winch(int i)
 {
@@ -182,7 +405,93 @@ void winch(int i)
 	{
 		signal(i,winch);	/* to let it refire */
 	}
+#ifdef HAVE_POLL
+	ev_wake();
+#endif
+}
+
+#ifdef EVENT_PIPE
+static void ev_init(void)
+{
+	/* the signal handler and workers write to the pipe so a wait for a
+		key does not miss them */
+	int i;
+
+	if (pipe(ev_fd))
+	{
+		ev_fd[0]=-1;
+		ev_fd[1]=-1;
+		return;
+	}
+
+	for (i=0; i < 2; i++)
+	{
+		fcntl(ev_fd[i],F_SETFL,fcntl(ev_fd[i],F_GETFL)|O_NONBLOCK);
+#	ifdef FD_CLOEXEC
+		fcntl(ev_fd[i],F_SETFD,FD_CLOEXEC);
+#	endif
+	}
+}
+#endif
+
+#ifdef HAVE_POLL
+static int ev_wait(int ms,int fd)
+{
+	/* wait for a key, for fd or for a wake, 1 for a key, 2 for fd,
+		-1 if woken and 0 after ms */
+	struct pollfd fds[3];
+	int n=1,w=-1,f=-1,i;
+
+	fds[0].fd=0;
+
+	if (ev_fd[0]!=-1)
+	{
+		w=n++;
+		fds[w].fd=ev_fd[0];
+	}
+
+	if (fd!=-1)
+	{
+		f=n++;
+		fds[f].fd=fd;
+	}
+
+	for (i=0; i < n; i++)
+	{
+		fds[i].events=POLLIN;
+		fds[i].revents=0;
+	}
+
+	i=poll(fds,n,ms);
+
+	if (i < 0)
+	{
+		/* a key read will say what is wrong */
+		return (errno==EINTR) ? -1 : 1;
+	}
+
+	if ((w!=-1) && fds[w].revents)
+	{
+		char buf[64];
+
+		while (read(ev_fd[0],buf,sizeof(buf)) > 0)
+		{
+		}
+	}
+
+	if (fds[0].revents)
+	{
+		return 1;
+	}
+
+	if ((f!=-1) && fds[f].revents)
+	{
+		return 2;
+	}
+
+	return i ? -1 : 0;
 }
+#endif
 
 static int ed_check(char *fname,FILE **fpOut)
 {
@@ -289,19 +598,141 @@ static char *strjoin(char *fmt,...)
 	return retval;
 }
 
+#if defined(SPILL_COMPACT) || defined(FIND_INDEX)
+static int idle_step(void)
+{
+	/* one slice of background work, 0 when there is none left */
+#ifdef SPILL_COMPACT
+	if (ed_compact()) return 1;
+#endif
+#ifdef FIND_INDEX
+	if (mx_step()) return 1;
+#endif
+	return 0;
+}
+
+static void tty_idle(void)
+{
+	/* background work runs in slices for as long as no key is waiting */
+	while (idle_step())
+	{
+		if ((ev_wait(0,-1) > 0) || winched)
+		{
+			break;
+		}
+	}
+}
+#endif
+
+#ifdef FOLLOW_FILE
+static int follow_wait(void)
+{
+	/* wait for a key or for the followed file to change,
+		returns 1 for a change, 0 for a key or -1 if interrupted */
+	while (forever)
+	{
+		int i;
+
+		if (winched)
+		{
+			return -1;
+		}
+
+		i=ev_wait((follow_ino!=-1) ? -1 : FOLLOW_POLL,follow_ino);
+
+		if (i==1)
+		{
+			return 0;
+		}
+
+		if (i==2)
+		{
+			char buf[4096];
+
+			if ((read(follow_ino,buf,sizeof(buf)) < 0) && (errno!=EINTR) && (errno!=EAGAIN))
+			{
+				/* no more to be heard from it, so look now and then */
+				close(follow_ino);
+				follow_ino=-1;
+			}
+
+			return 1;
+		}
+
+		if (!i)
+		{
+			struct stat s;
+
+			if (fstat(follow_fd,&s) || (s.st_size != follow_pos) || follow_moved())
+			{
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+#endif
+
 static int co_getch(void)
 {
 	while (forever)
 	{
 		char buf[1];
 		int i;
-#ifdef SIGTTIN
-		aedit_siginterrupt(SIGWINCH,1);
+#if defined(SPILL_COMPACT) || defined(FIND_INDEX)
+		tty_idle();
 #endif
-		i=tty_read(0,buf,1);
-#ifdef SIGTTIN
-		aedit_siginterrupt(SIGWINCH,0);
+#ifdef JOURNAL
+		jn_wait();
+#endif
+#ifdef SAVE_THREAD
+		sv_idle();
+#endif
+#ifdef FOLLOW_FILE
+		if (follow_key)
+		{
+			/* only the main loop asks to hear about the file growing */
+			follow_key=0;
+			i=follow_wait();
+
+			if (i)
+			{
+				return (i > 0) ? key_grow : -1;
+			}
+		}
+#endif
+#ifdef JOB_CANCEL
+		if (key_iahead < key_nahead)
+		{
+			/* typed while a job was running */
+			buf[0]=key_ahead[key_iahead++];
+			i=1;
+		}
+		else
+#endif
+		{
+#ifdef HAVE_POLL
+			/* the read only happens once there is a key, a resize
+				or a worker finishing wakes the wait instead */
+			if (ev_wait(winched ? 0 : -1,-1) < 1)
+			{
+				if (winched)
+				{
+					break;
+				}
+
+				continue;
+			}
+#endif
+#if defined(SIGTTIN) && !defined(HAVE_POLL)
+			aedit_siginterrupt(SIGWINCH,1);
 #endif
+			i=tty_read(0,buf,1);
+#if defined(SIGTTIN) && !defined(HAVE_POLL)
+			aedit_siginterrupt(SIGWINCH,0);
+#endif
+		}
 		if (i==1) 
 		{
 			if (buf[0] != ctrl_s)
@@ -326,6 +757,118 @@ static int co_getch(void)
 	return -1;
 }
 
+#ifdef ESC_DELAY
+static int co_ready(int ms)
+{
+	/* non zero if a key comes within ms */
+	int i;
+
+	if (key_iahead < key_nahead)
+	{
+		return 1;
+	}
+
+	do
+	{
+		i=ev_wait(ms,-1);
+	} while ((i < 0) && !winched);
+
+	return i > 0;
+}
+
+static void co_ungetch(int c)
+{
+	/* the next co_getch gets c again */
+	if (key_iahead < key_nahead)
+	{
+		key_iahead--;
+	}
+	else
+	{
+		key_iahead=0;
+		key_nahead=1;
+		key_ahead[0]=(char)c;
+	}
+}
+
+#ifdef PASTE_WAIT
+static long co_paste(char *buf,long n)
+{
+	/* the next piece of a paste as it is, without going through
+		getkey, 0 once ESC [ 201 ~ or nothing more comes */
+	static char end[]="\033[201~";
+	static int cr;
+	long i=0;
+	int m=0;
+
+	while (pasting && (m || ((i+(long)sizeof(end)) < n)))
+	{
+		int c;
+
+		if (key_iahead==key_nahead)
+		{
+			int r=ev_wait(PASTE_WAIT,-1);
+
+			if (r < 0)
+			{
+				continue;
+			}
+
+			key_iahead=0;
+			key_nahead=r ? (int)tty_read(0,key_ahead,sizeof(key_ahead)) : 0;
+
+			if (key_nahead <= 0)
+			{
+				key_nahead=0;
+				pasting=0;
+				break;
+			}
+		}
+
+		c=key_ahead[key_iahead++];
+
+		if (c==end[m])
+		{
+			if (!end[++m])
+			{
+				pasting=0;
+			}
+
+			continue;
+		}
+
+		if (m)
+		{
+			/* not the end after all, c is looked at again */
+			memcpy(buf+i,end,m);
+			i+=m;
+			m=0;
+			cr=0;
+			key_iahead--;
+			continue;
+		}
+
+		/* terminals send RETURN for a new line */
+		if ((c==nl) && cr)
+		{
+			cr=0;
+			continue;
+		}
+
+		cr=(c==13);
+		buf[i++]=(char)(cr ? nl : c);
+	}
+
+	if (!pasting)
+	{
+		cr=0;
+	}
+
+	return i;
+}
+#endif
+#endif
+
 #if defined(HAVE_TERMIOS_H) && !defined(HAVE_CFMAKERAW)
 static void cfmakeraw(struct termios *tt)
 {
@@ -367,10 +910,18 @@ struct sgttyb temp_mode;
 #	endif
 #endif
 
+#ifdef SPILL_COMPACT
+#	define COMPACT_MIN		1048576L	/* dead spill space worth reclaiming */
+#	define COMPACT_STEP		65536L		/* bytes moved per idle slice */
+#endif
+
 int total_lines=24;
 int total_cols=80;
 
 char wordwrap=0;
+char find_regex=0;
+char find_nocase=0;
+char find_word=0;
 long again=0;
 char rev_menu=1;
 int tabs=4;
@@ -378,7 +929,7 @@ int tabs=4;
 int row,col;
 
 int crsr_row,crsr_col,tty_row,tty_col;
-long sel_pos=0;
+ed_off sel_pos=0;
 int sel_on=0,rev_on=0;
 int mode=0,menu_id=0,menu_nxt=0,menu_erased=0;
 int show_size=0;
@@ -389,7 +940,7 @@ int show_size=0;
  *
  */
 
-long page_start;
+ed_off page_start;
 
 static char *filename;
 static int chars_per_line[max_lines];
@@ -419,11 +970,18 @@ struct ed_file
 	int t_fd;
 #endif
 	/* temp file stats */
-	long t_lol; /* temp low length */
-	long t_hip; /* temp high offset */
-	long t_hil; /* temp high length */
-	long t_capos; /* cache position */
+	ed_off t_lol; /* temp low length */
+	ed_off t_hip; /* temp high offset */
+	ed_off t_hil; /* temp high length */
+	ed_off t_capos; /* cache position */
 	long t_calen; /* cache length */
+	ed_off t_cdst; /* compaction destination of high part */
+	ed_off t_cmv; /* compaction high bytes already moved */
+#ifdef HAVE_MMAP
+	char *t_map; /* read only map of temp file */
+	ed_off t_mlen; /* mapped length */
+	int t_mstale; /* file may have grown past map */
+#endif
 	char t_cache[512];
 } cur_file={
 #ifdef MALLOC_SIZE
@@ -437,11 +995,13 @@ struct ed_file
 #else
 	-1,
 #endif
-	0,0,0,0,0
+	0,0,0,0,0,0,0
 };
 
 #ifdef TEMP_FP
+#	define ed_fd()	fileno(cur_file.t_fp)
 #else
+#	define ed_fd()	cur_file.t_fd
 char tmpname[1024];
 #endif
 
@@ -482,7 +1042,7 @@ static int tty_reset(int fd)
 #endif /* QNX */
 }
 
-static long ed_len(void)
+static ed_off ed_len(void)
 {
 	return cur_file.low_size+cur_file.high_size+cur_file.t_lol+cur_file.t_hil;
 }
@@ -492,12 +1052,13 @@ static long ed_room(void)
 	return cur_file.buf_size-cur_file.low_size-cur_file.high_size;
 }
 
-static void ed_seek(long p)
+#ifndef HAVE_PREAD
+static void ed_seek(ed_off p)
 {
-	long q;
+	ed_off q;
 #ifdef TEMP_FP
-	fseek(cur_file.t_fp,p,SEEK_SET);
-	q=ftell(cur_file.t_fp);
+	ed_fseek(cur_file.t_fp,p,SEEK_SET);
+	q=ed_ftell(cur_file.t_fp);
 #else
 	q=lseek(cur_file.t_fd,p,SEEK_SET);
 #endif
@@ -509,22 +1070,32 @@ static void ed_seek(long p)
 		exit(1);
 	}
 }
+#endif
 
-static void ed_read(char *p,long l)
+static void ed_read(ed_off pos,char *p,long l)
 {
 	size_t len=l;
 
+#ifndef HAVE_PREAD
+	ed_seek(pos);
+#endif
+
 	while (len)
 	{
-#ifdef TEMP_FP
-		size_t i=fread(p,1,len,cur_file.t_fp);
+#ifdef HAVE_PREAD
+		ssize_t i=pread(ed_fd(),p,len,pos);
 #else
+#	ifdef TEMP_FP
+		size_t i=fread(p,1,len,cur_file.t_fp);
+#	else
 		int i=read(cur_file.t_fd,p,len);
+#	endif
 #endif
 		if (i > 0)
 		{
 			len-=i;
 			p+=i;
+			pos+=i;
 		}
 		else
 		{
@@ -535,36 +1106,88 @@ static void ed_read(char *p,long l)
 	}
 }
 
-static void ed_tzap(void)
+#ifdef HAVE_MMAP
+static void ed_unmap(void)
 {
-	cur_file.t_capos=0;
-	cur_file.t_calen=0;
+	if (cur_file.t_map)
+	{
+		munmap(cur_file.t_map,(size_t)cur_file.t_mlen);
+		cur_file.t_map=NULL;
+		cur_file.t_mlen=0;
+	}
+
+	cur_file.t_mstale=1;
+}
+
+static void ed_map(void)
+{
+	/* map the whole temp file, writes still go through
+		the file and show up in the shared map */
+	struct stat s;
+
+	ed_unmap();
+
+	cur_file.t_mstale=0;
+
+	if (!fstat(ed_fd(),&s) && s.st_size && ((off_t)(size_t)s.st_size == s.st_size))
+	{
+		void *p=mmap(NULL,(size_t)s.st_size,PROT_READ,MAP_SHARED,ed_fd(),0);
+
+		if (p != MAP_FAILED)
+		{
+			cur_file.t_map=p;
+			cur_file.t_mlen=s.st_size;
+		}
+	}
+}
+#endif
+
+static void ed_tzap(void)
+{
+	cur_file.t_capos=0;
+	cur_file.t_calen=0;
 
 #ifdef _DEBUG
 /*	printf("ed_tzap\n");*/
 #endif
 }
 
-static void ed_write(char *p,long l)
+static void ed_write(ed_off pos,char *p,long l)
 {
 	size_t len=l;
 
+#ifdef SAVE_THREAD
+	sv_hold(pos,l);
+#endif
+
 	if (len)
 	{
 		ed_tzap();
+#ifdef HAVE_MMAP
+		cur_file.t_mstale=1;
+#endif
 	}
 
+#ifndef HAVE_PREAD
+	ed_seek(pos);
+#endif
+
 	while (len)
 	{
-#ifdef TEMP_FP
-		size_t i=fwrite(p,1,len,cur_file.t_fp);
+#ifdef HAVE_PREAD
+		ssize_t i=pwrite(ed_fd(),p,len,pos);
 #else
+#	ifdef TEMP_FP
+		size_t i=fwrite(p,1,len,cur_file.t_fp);
+#	else
 		int i=write(cur_file.t_fd,p,len);
+#	endif
 #endif
 		if (i > 0)
 		{
 			len-=i;
 			p+=i;
+			pos+=i;
 		}
 		else
 		{
@@ -579,23 +1202,41 @@ static void ed_write(char *p,long l)
 #endif
 }
 
-static void ed_fclr(long pos,long len)
+static void ed_fclr(ed_off pos,long len)
 {
 	char buf[256];
 	char *p=buf;
 	int i=sizeof(buf);
+
+#ifdef SAVE_THREAD
+	if (sv_need(pos,len))
+	{
+		/* a save has still to read them, they need not be zero */
+		return;
+	}
+#endif
+
+#ifdef HAVE_FALLOC_PUNCH_HOLE
+	/* hand the blocks back rather than writing zeros over them */
+	if (len && !fallocate(ed_fd(),FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,pos,len))
+	{
+		ed_tzap();
+		return;
+	}
+#endif
+
 	while (i--) { *p=0; p++; }
-	ed_seek(pos);
 	while (len)
 	{
 		if (len > sizeof(buf))
 		{
-			ed_write(buf,sizeof(buf));
+			ed_write(pos,buf,sizeof(buf));
+			pos+=sizeof(buf);
 			len-=(sizeof(buf));
 		}
 		else
 		{
-			ed_write(buf,len);
+			ed_write(pos,buf,len);
 			len=0;
 		}
 	}
@@ -603,6 +1244,10 @@ static void ed_fclr(long pos,long len)
 
 static void ed_load(long l)
 {
+#ifdef SPILL_COMPACT
+	ed_cfin();
+#endif
+
 	if (l)
 	{
 		if (l > 0)
@@ -614,7 +1259,7 @@ static void ed_load(long l)
 
 			if (l > cur_file.t_hil)
 			{
-				l=cur_file.t_hil;
+				l=(long)cur_file.t_hil;
 			}
 
 			if (l)
@@ -632,8 +1277,7 @@ static void ed_load(long l)
 					*tgt++=(*src++);
 				}
 
-				ed_seek(cur_file.t_hip);
-				ed_read(tgt,l);
+				ed_read(cur_file.t_hip,tgt,l);
 				ed_fclr(cur_file.t_hip,l);
 
 				cur_file.high_size+=l;
@@ -652,7 +1296,7 @@ static void ed_load(long l)
 
 			if (l > cur_file.t_lol)
 			{
-				l=cur_file.t_lol;
+				l=(long)cur_file.t_lol;
 			}
 
 			if (l)
@@ -670,8 +1314,7 @@ static void ed_load(long l)
 					*--tgt=(*--src);
 				}
 
-				ed_seek(cur_file.t_lol-l);
-				ed_read(cur_file.buffer,l);
+				ed_read(cur_file.t_lol-l,cur_file.buffer,l);
 
 				ed_fclr(cur_file.t_lol-l,l);
 
@@ -682,9 +1325,9 @@ static void ed_load(long l)
 	}
 }
 
-static int ed_at(long pos)
+static int ed_at(ed_off pos)
 {
-	long off=pos;
+	ed_off off=pos;
 	int c=EOF;
 
 #if defined(_WIN32) && defined(_M_IX86)
@@ -731,7 +1374,16 @@ static int ed_at(long pos)
 
 				if (off < cur_file.t_hil)
 				{
-					off+=cur_file.t_hip;
+#ifdef SPILL_COMPACT
+					if (off < cur_file.t_cmv)
+					{
+						off+=cur_file.t_cdst;
+					}
+					else
+#endif
+					{
+						off+=cur_file.t_hip;
+					}
 	
 					c=ed_chr(off);
 
@@ -752,12 +1404,24 @@ static int ed_at(long pos)
 	return c;
 }
 
-static int ed_chr(long off)
+static int ed_chr(ed_off off)
 {
-	long mask=sizeof(cur_file.t_cache);
+	ed_off mask=sizeof(cur_file.t_cache);
 	mask--;
 	mask=(~mask);
 
+#ifdef HAVE_MMAP
+	if ((off >= cur_file.t_mlen) && cur_file.t_mstale)
+	{
+		ed_map();
+	}
+
+	if (off < cur_file.t_mlen)
+	{
+		return cur_file.t_map[off];
+	}
+#endif
+
 	do
 	{
 		if (off >= cur_file.t_capos)
@@ -769,18 +1433,24 @@ static int ed_chr(long off)
 		}
 
 		cur_file.t_capos=(mask & off);
-		ed_seek(cur_file.t_capos);
 
 #ifdef _DEBUG
-		printf("read cache at %ld\n",cur_file.t_capos);
+		printf("read cache at %ld\n",(long)cur_file.t_capos);
 #endif
 
-#ifdef TEMP_FP
+#ifdef HAVE_PREAD
+		cur_file.t_calen=(long)pread(ed_fd(),cur_file.t_cache,
+			sizeof(cur_file.t_cache),
+			cur_file.t_capos);
+#else
+		ed_seek(cur_file.t_capos);
+#	ifdef TEMP_FP
 		cur_file.t_calen=(long)fread(cur_file.t_cache,1,
 			sizeof(cur_file.t_cache),
 			cur_file.t_fp);
-#else
+#	else
 		cur_file.t_calen=read(cur_file.t_fd,cur_file.t_cache,sizeof(cur_file.t_cache));
+#	endif
 #endif
 
 	} while (cur_file.t_calen > 0);
@@ -788,2811 +1458,9146 @@ static int ed_chr(long off)
 	return EOF;
 }
 
-static void ed_del(long hwmany)
+#define SPAN_MAX	0x40000000L
+
+static char *ed_fspan(ed_off off,ed_off lo,ed_off hi,ed_off *start,long *len)
 {
-	ADBG_DEL(hwmany)
+	/* bytes of the temp file around off that are contiguous in memory,
+		clipped to [lo,hi) */
+	char *p;
+	ed_off m=off & ~(ed_off)(SPAN_MAX-1);
 
-	ed_tzap();
+	if (lo < m) lo=m;
+	if (hi > (m+SPAN_MAX)) hi=m+SPAN_MAX;
 
-	/* delete number of chars */
-	if (hwmany)
+	ed_chr(off);
+
+#ifdef HAVE_MMAP
+	if (off < cur_file.t_mlen)
 	{
-		if (hwmany > 0)
-		{
-			/* delete forward characters */
+		if (hi > cur_file.t_mlen) hi=cur_file.t_mlen;
+		p=cur_file.t_map+lo;
+	}
+	else
+#endif
+	{
+		if (lo < cur_file.t_capos) lo=cur_file.t_capos;
+		if (hi > (cur_file.t_capos+cur_file.t_calen)) hi=cur_file.t_capos+cur_file.t_calen;
+		p=cur_file.t_cache+(lo-cur_file.t_capos);
+	}
 
-			if (hwmany > cur_file.high_size)
-			{
-				hwmany-=cur_file.high_size;
-				cur_file.high_size=0;
-				cur_file.t_hip+=hwmany;
-				cur_file.t_hil-=hwmany;
-			}
-			else
-			{
-				cur_file.high_size-=hwmany;
-			}
-		}
-		else
-		{
-			hwmany=(-hwmany);
+	*start=lo;
+	*len=(long)(hi-lo);
 
-			if (hwmany > cur_file.low_size)
-			{
-				hwmany-=cur_file.low_size;
-				cur_file.low_size=0;
-				cur_file.t_lol-=hwmany;
-			}
-			else
-			{
-				cur_file.low_size-=hwmany;
-			}
+	return p;
+}
 
-			/* delete backward characters */
-		}
+static char *ed_span(ed_off pos,ed_off *start,long *len)
+{
+	/* the run of document bytes containing pos that is contiguous
+		in memory, good until the document or cache next changes */
+	ed_off off=pos-cur_file.t_lol;
+	ed_off fo=cur_file.t_hip,lo=0,hi=cur_file.t_hil;
+	char *p;
+
+	if (off < 0)
+	{
+		return ed_fspan(pos,0,cur_file.t_lol,start,len);
+	}
+
+	if (off < cur_file.low_size)
+	{
+		*start=cur_file.t_lol;
+		*len=cur_file.low_size;
+		return cur_file.buffer;
+	}
+
+	off-=cur_file.low_size;
+
+	if (off < cur_file.high_size)
+	{
+		*start=pos-off;
+		*len=cur_file.high_size;
+		return cur_file.buffer+cur_file.buf_size-cur_file.high_size;
+	}
+
+	off-=cur_file.high_size;
+
+#ifdef SPILL_COMPACT
+	if (off < cur_file.t_cmv)
+	{
+		fo=cur_file.t_cdst;
+		hi=cur_file.t_cmv;
+	}
+	else
+	{
+		lo=cur_file.t_cmv;
 	}
+#endif
+
+	p=ed_fspan(fo+off,fo+lo,fo+hi,start,len);
+
+	*start+=pos-off-fo;
+
+	return p;
 }
 
-static void ed_ins(int ch)
+#if defined(FIND_PARALLEL) || defined(SPAN_COPY)
+static char *ed_where(ed_off pos,long *len,ed_off *fo)
 {
-	/* add character at cursor position */
+	/* where up to *len document bytes at pos are in one run, in
+		the buffer or else at *fo in the temp file */
+	ed_off off=pos-cur_file.t_lol;
+	ed_off end;
 
-	ADBG_INS(ch)
+	if (off < 0)
+	{
+		*fo=pos;
+		end=cur_file.t_lol;
+	}
+	else
+	{
+		if (off < cur_file.low_size)
+		{
+			if (*len > (cur_file.low_size-off)) *len=(long)(cur_file.low_size-off);
 
-	ed_tzap();
+			return cur_file.buffer+off;
+		}
 
-	while (forever)
-	{
-		if ((cur_file.low_size+cur_file.high_size) < cur_file.buf_size)
+		off-=cur_file.low_size;
+
+		if (off < cur_file.high_size)
 		{
-			cur_file.buffer[cur_file.low_size++]=(char)ch;
-			break;
+			if (*len > (cur_file.high_size-off)) *len=(long)(cur_file.high_size-off);
+
+			return cur_file.buffer+cur_file.buf_size-cur_file.high_size+off;
 		}
-		else
+
+		off-=cur_file.high_size;
+
+#ifdef SPILL_COMPACT
+		if (off < cur_file.t_cmv)
 		{
-			long l=1;
-			if (ed_reserve(l))
-			{
-#if defined(_WIN32) && defined(_M_IX86)
-				__asm int 3;
+			*fo=cur_file.t_cdst+off;
+			end=cur_file.t_cdst+cur_file.t_cmv;
+		}
+		else
 #endif
-			}
-
-			/* try and keep mid buffer */
-			if (cur_file.high_size > cur_file.low_size)
-			{
-				l=cur_file.high_size;
-				l>>=1;
-				ed_dump(l);
-			}
-			else
-			{
-				l=cur_file.low_size;
-				l>>=1;
-				ed_dump(-l);
-			}
+		{
+			*fo=cur_file.t_hip+off;
+			end=cur_file.t_hip+cur_file.t_hil;
 		}
 	}
+
+	if (*len > (end-*fo)) *len=(long)(end-*fo);
+
+	return NULL;
 }
+#endif
 
-static void ed_dump(long p)
+#ifdef FIND_PARALLEL
+static char *ed_piece(ed_off pos,long *len,char *dst)
 {
-	/* move bytes out of buffer into file,
-		-v means low part, +ve means high part */
-
-	ed_tzap();
+	/* up to *len document bytes at pos from a single region, file
+		bytes that are not mapped are read into dst, it only reads
+		so worker threads can use it while the main thread waits */
+	ed_off fo;
+	char *p=ed_where(pos,len,&fo);
 
 	if (p)
 	{
-		char *p1,*p2;
-		long l;
+		return p;
+	}
 
-		if (p > 0)
-		{
-#ifdef _DEBUG
-			printf("dumping %ld from top\n",p);
+#ifdef HAVE_MMAP
+	if ((fo+*len) <= cur_file.t_mlen)
+	{
+		return cur_file.t_map+fo;
+	}
 #endif
-			/* move buffer to top half file */
 
-			if (p > cur_file.high_size)
-			{
-				p=cur_file.high_size;
-			}
+	ed_read(fo,dst,*len);
 
-			if (p)
-			{
-				ed_reserve(p);
+	return dst;
+}
 
-#ifdef _DEBUG
-				if ((cur_file.t_lol+p)>cur_file.t_hip)
-				{
-					/* not enough room in temp */
-#if defined(_WIN32) && defined(_M_IX86)
-					__asm int 3;
-#endif
-				}
+static char *ed_pget(ed_off pos,long n,char *buf)
+{
+	/* n document bytes at pos, in place if they are in one region,
+		otherwise gathered into buf */
+	long k=0;
 
-				printf("room is %ld\n",cur_file.t_hip-cur_file.t_lol);
-				printf("actually dumping %ld\n",p);
-				printf("high size is %ld\n",cur_file.high_size);
+	while (k < n)
+	{
+		long l=n-k;
+		char *p=ed_piece(pos+k,&l,buf+k);
+
+		if ((!k) && (l==n))
+		{
+			return p;
+		}
+
+		if (p != (buf+k))
+		{
+			memcpy(buf+k,p,l);
+		}
+
+		k+=l;
+	}
+
+	return buf;
+}
 #endif
-				cur_file.t_hip-=p;
-				cur_file.t_hil+=p;
 
-				ed_seek(cur_file.t_hip);
+#define fold(c)		((((c) >= 'A') && ((c) <= 'Z')) ? ((c)|0x20) : (c))
+#define unfold(c)	((((c) >= 'a') && ((c) <= 'z')) ? ((c)&~0x20) : (c))
 
-				p1=cur_file.buffer;
-				p1+=cur_file.buf_size;
-				p1-=p /*cur_file.high_size*/;
+static int is_word(int c)
+{
+	/* bytes that make up a word, anything past ASCII counts */
+	return (((c|0x20) >= 'a') && ((c|0x20) <= 'z'))
+		|| ((c >= '0') && (c <= '9')) || (c=='_') || (c & 0x80);
+}
 
-				ed_write(p1,p);
+static char *find_first(char *p,char *z,int c0,int c1)
+{
+	/* first byte in [p,z) that is c0 or c1 */
+	if (c0==c1)
+	{
+		return memchr(p,c0,z-p);
+	}
 
-				cur_file.high_size-=p;
+#ifdef FOLD_SSE2
+	{
+		__m128i a=_mm_set1_epi8((char)c0);
+		__m128i b=_mm_set1_epi8((char)c1);
 
-				p1=cur_file.buffer+cur_file.buf_size;
-				p2=p1-p;
+		while ((z-p) >= 16)
+		{
+			__m128i x=_mm_loadu_si128((__m128i *)p);
+			int m=_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x,a),_mm_cmpeq_epi8(x,b)));
 
-				l=cur_file.high_size;
-				while (l--)
+			if (m)
+			{
+				while (!(m & 1))
 				{
-					*--p1=(*--p2);
+					m>>=1;
+					p++;
 				}
+
+				return p;
 			}
+
+			p+=16;
 		}
-		else
-		{
-			p=(-p);
+	}
+#endif
 
-#ifdef _DEBUG
-			printf("dumping %ld from bottom\n",p);
-#endif
+	while (p < z)
+	{
+		if ((*p==(char)c0) || (*p==(char)c1))
+		{
+			return p;
+		}
 
-			ed_reserve(p);
+		p++;
+	}
 
-#ifdef _DEBUG
-			if ((cur_file.t_lol+p)>cur_file.t_hip)
-			{
-#if defined(_WIN32) && defined(_M_IX86)
-				__asm int 3;
-#endif
-			}
-#endif
+	return NULL;
+}
 
-			/* move buffer to bottom half file */
+#ifdef FIND_PARALLEL
+static int fold_cmp(char *a,char *b,long n)
+{
+	/* compare a with b ignoring case, b is already lower case */
+#ifdef FOLD_SSE2
+	__m128i k=_mm_set1_epi8(0x3f);
+	__m128i u=_mm_set1_epi8(-102);
+	__m128i l=_mm_set1_epi8(0x20);
 
-			if (p > cur_file.low_size)
-			{
-				p=cur_file.low_size;
-			}
+	while (n >= 16)
+	{
+		__m128i x=_mm_loadu_si128((__m128i *)a);
 
-			if (p)
-			{
-				ed_seek(cur_file.t_lol);
-				ed_write(cur_file.buffer,p);
+		/* 'A' to 'Z' move to the bottom of the signed range */
+		x=_mm_or_si128(x,_mm_and_si128(_mm_cmplt_epi8(_mm_add_epi8(x,k),u),l));
 
-				p1=cur_file.buffer;
-				p2=cur_file.buffer+p;
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x,_mm_loadu_si128((__m128i *)b)))!=0xffff)
+		{
+			return 1;
+		}
 
-				cur_file.low_size-=p;
-				cur_file.t_lol+=p;
+		a+=16;
+		b+=16;
+		n-=16;
+	}
+#endif
 
-				l=cur_file.low_size;
+	while (n--)
+	{
+		int c=*a++;
 
-				while (l--)
-				{
-					*p1++=(*p2++);
-				}
-			}
+		if (fold(c)!=(*b++))
+		{
+			return 1;
 		}
 	}
-	else
-	{
-		/* flush entire buffer */
 
-		p=cur_file.low_size + cur_file.high_size;
-
-#ifdef _DEBUG
-		printf("dumping entire %ld buffer\n",p);
+	return 0;
+}
 #endif
 
-		if (ed_reserve(p))
-		{
-#if defined(_WIN32) && defined(_M_IX86)
-			__asm int 3;
+#if defined(FIND_PARALLEL) || defined(FIND_INDEX)
+static void fold_str(char *d,char *s)
+{
+	do
+	{
+		int c=*s;
+		*d++=(char)fold(c);
+	} while (*s++);
+}
 #endif
-		}
-
-		if (cur_file.low_size)
-		{
-			ed_dump(-cur_file.low_size);
-		}
 
-		if (cur_file.high_size)
-		{
-			ed_dump(cur_file.high_size);
-		}
+static int word_ok(ed_off p,long n)
+{
+	/* nothing that is part of a word either side of [p,p+n) */
+	if (p && is_word(0xff & ed_at(p-1)))
+	{
+		return 0;
 	}
+
+	return ((p+n) >= ed_len()) || !is_word(0xff & ed_at(p+n));
 }
 
-static long ed_pos(void)
+#ifdef FIND_INDEX
+#define MX_SLICE	0x100000L
+#define MX_PAINT	256
+
+static struct
 {
-	return cur_file.low_size+cur_file.t_lol;
+	ed_off *at;	/* match starts, below the gap counted from the
+				start of the document, above it from the end */
+	long size,low,high;
+	ed_off done;	/* every match starting before here is in */
+	ed_off cut;	/* where an edit has to be looked at again */
+	long len;
+	char pat[max_cols];
+	char fpat[max_cols];	/* folded */
+	char nocase,word;
+} mx={NULL,0,0,0,0,-1,0};
+
+static ed_off mx_cur=-1;	/* start of the match last found */
+
+static void mx_free(void)
+{
+	if (mx.at)
+	{
+		free(mx.at);
+		mx.at=NULL;
+	}
+
+	mx.size=0;
+	mx.low=0;
+	mx.high=0;
+	mx.done=0;
+	mx.cut=-1;
 }
 
-static void ed_seof(long l)
+static int mx_set(char *p)
 {
-	while (forever)
+	/* index p from scratch, unless it already is */
+	if (mx.at && !strcmp(mx.pat,p) && (mx.nocase==find_nocase) && (mx.word==find_word))
 	{
-		long m;
-		char buf[512];
+		return 0;
+	}
 
-		m=sizeof(buf);
+	mx_free();
 
-		while (m--) buf[m]=0;
+	if (*p)
+	{
+		mx.size=1024;
+		mx.at=malloc(mx.size*sizeof(mx.at[0]));
+		strcpy(mx.pat,p);
+		fold_str(mx.fpat,p);
+		mx.len=(long)strlen(p);
+		mx.nocase=find_nocase;
+		mx.word=find_word;
+	}
 
-#ifdef TEMP_FP
-		fseek(cur_file.t_fp,0L,SEEK_END);
-		m=ftell(cur_file.t_fp);
-#else
-		m=lseek(cur_file.t_fd,0L,SEEK_END);
-#endif
+	return 1;
+}
+
+static ed_off mx_get(long i)
+{
+	if (i < mx.low)
+	{
+		return mx.at[i];
+	}
 
-		m=l-m;
+	return ed_len()-mx.at[mx.size-mx.high+(i-mx.low)];
+}
 
-		if (m <= 0) 
-		{
-			if (m < 0)
-			{
-				perror("seof");
-				tty_reset(0);
-				exit(1);
-			}
+static long mx_rank(ed_off x)
+{
+	/* how many matches start before x */
+	long lo=0,hi=mx.low+mx.high;
 
-#ifdef TEMP_FP
-			fflush(cur_file.t_fp);
-#endif
-			break;
-		}
+	while (lo < hi)
+	{
+		long m=lo+((hi-lo)>>1);
 
-		if (m > sizeof(buf))
+		if (mx_get(m) < x)
 		{
-			m=sizeof(buf);
+			lo=m+1;
+		}
+		else
+		{
+			hi=m;
 		}
-
-		ed_write(buf,m);
 	}
+
+	return lo;
 }
 
-static int ed_reserve(long l)
+static void mx_gap(ed_off x)
 {
-	ed_tzap();
-
-	if (!l) return 0;
+	/* move the gap to x, so only matches before it are below */
+	ed_off n=ed_len();
 
-	l-=(cur_file.t_hip - cur_file.t_lol);
+	while (mx.low && (mx.at[mx.low-1] >= x))
+	{
+		mx.high++;
+		mx.low--;
+		mx.at[mx.size-mx.high]=n-mx.at[mx.low];
+	}
 
-	if (l <= 0 )
+	while (mx.high && ((n-mx.at[mx.size-mx.high]) < x))
 	{
-		/* enough space in file */
+		mx.at[mx.low++]=n-mx.at[mx.size-mx.high];
+		mx.high--;
+	}
+}
 
+static int mx_match(ed_off p)
+{
+	char *q=mx.nocase ? mx.fpat : mx.pat;
+	long i=mx.len;
+	ed_off s=p;
+
+	if ((p < 0) || ((p+i) > ed_len()))
+	{
 		return 0;
 	}
 
-#ifdef _DEBUG
-	printf("ed_reserve %ld bytes\n",l);
-#endif
+	while (i--)
+	{
+		int c=ed_at(p++);
 
-	ed_seof(l+cur_file.t_hip+cur_file.t_hil);
+		if (mx.nocase) c=fold(c);
 
-	if (cur_file.t_hil)
+		if (c!=(*q++))
+		{
+			return 0;
+		}
+	}
+
+	return (!mx.word) || word_ok(s,mx.len);
+}
+
+static void mx_scan(ed_off p,ed_off e)
+{
+	/* add the matches starting in [p,e), the gap must be at p */
+	int c0=(unsigned char)mx.pat[0];
+	int c1=c0;
+
+	if (mx.nocase)
 	{
-		/* have to shuffle up the high portion */
+		c0=fold(c0);
+		c1=unfold(c0);
+	}
 
-		long n=cur_file.t_hil;
-		long src=cur_file.t_hil+cur_file.t_hip;
-		long tgt=src+l;
+	if (e > (ed_len()-mx.len+1))
+	{
+		e=ed_len()-mx.len+1;
+	}
 
-#ifdef _DEBUG
-		printf("shuffle(n=%ld,l=%ld)\n",n,l);
-#endif
+	while (mx.at && (p < e))
+	{
+		ed_off st;
+		long n;
+		char *b=ed_span(p,&st,&n);
+		char *q;
 
-		while (n)
+		if ((st+n) > e) n=(long)(e-st);
+
+		q=find_first(b+(p-st),b+n,c0,c1);
+
+		if (!q)
 		{
-			long m=n;
-			char buf[512];
+			p=st+n;
+			continue;
+		}
 
-			if (m > sizeof(buf))
+		p=st+(q-b);
+
+		if (mx_match(p))
+		{
+			if ((mx.low+mx.high)==mx.size)
 			{
-				m=sizeof(buf);
-			}
+				ed_off *t=realloc(mx.at,2*mx.size*sizeof(mx.at[0]));
 
-			src-=m;
-			tgt-=m;
-			n-=m;
+				if (!t)
+				{
+					mx_free();
+					break;
+				}
 
-			ed_seek(src);
-			ed_read(buf,m);
-			ed_seek(tgt);
-			ed_write(buf,m);
-		}
-	}
+				memmove(t+2*mx.size-mx.high,t+mx.size-mx.high,mx.high*sizeof(t[0]));
+				mx.at=t;
+				mx.size*=2;
+			}
 
-	cur_file.t_hip+=l;
+			mx.at[mx.low++]=p;
+		}
 
-	return 0;
+		p++;
+	}
 }
 
-static void co_puts(char *p)
+static int mx_full(void)
 {
-	while (*p) putchar(*p++);
+	/* the index is complete and for the find string */
+	return mx.at && (mx.done > (ed_len()-mx.len)) && !strcmp(mx.pat,f_string)
+		&& (mx.nocase==find_nocase) && (mx.word==find_word);
 }
 
-static int tty_sz(int fd)
+static int mx_step(void)
 {
-#ifdef TIOCGWINSZ
-	struct winsize ws;
-	ws.ws_row=ws.ws_col=0;
-	if (!ioctl(fd,TIOCGWINSZ,&ws))
-	{
-		if ((ws.ws_col > 10) & (ws.ws_row > 4))
-		{
-			total_cols=ws.ws_col;
-			total_lines=ws.ws_row;
-			if (total_lines > max_lines) total_lines=max_lines;
-			return 0;
-		}
-	}
-#endif /* TIOCGWINSZ */
+	/* index the next slice in the background */
+	ed_off e;
 
-#ifdef _WIN32
+	if (!mx.at)
 	{
-		int cols,rows;
-		if (!tty_winsize(&cols,&rows))
-		{
-			total_cols=cols;
-			total_lines=rows;
-			if (total_lines > max_lines) total_lines=max_lines;
-			return 0;
-		}
+		return 0;
 	}
-#endif
 
-#ifdef ANSI_SYS
-#	ifdef PLOT_CTRL
-	/* plot cursor at bottom right and ask for the position */
-/*	co_puts("\033[127;127H\033[6n");*/
-	guessing=1;
-	co_puts("\033[127;127H\033[6n");
-	fflush(stdout);
-	if (ctrl_w==getkey())
+	e=ed_len()-mx.len+1;
+
+	if (mx.done >= e)
 	{
 		return 0;
 	}
-#	endif /* PLOT_CTRL */
-#else /* ANSI_SYS */
-#	ifdef _WIN32
-	co_puts("\033[?2l");
-	total_lines=25;
-#	endif /* _WIN32 */
-	guessing=1;
-	co_puts("\033Z");
-	fflush(stdout);
-	if (ctrl_w==getkey())
+
+	mx_gap(mx.done);
+
+	if (e > (mx.done+MX_SLICE)) e=mx.done+MX_SLICE;
+
+	mx_scan(mx.done,e);
+	mx.done=e;
+
+	if ((mx_cur >= 0) && mx_full())
 	{
-		return 0;
+		/* now the count is known */
+		show_status();
+		plot_cursor();
+		fflush(stdout);
 	}
-#endif /* ANSI_SYS */
 
-	return -1;
+	return 1;
 }
 
-static int getkey(void)
+static ed_off mx_next(ed_off x,ed_off lim)
 {
-	int k;
+	/* first match starting in [x,lim), past the indexed part
+		the text is looked at directly */
+	long i;
 
-#ifdef _DEBUG
-	dumpinfo();
-#endif
+	if (x < 0) x=0;
 
-	if (winched)
+	i=mx_rank(x);
+
+	if (i < (mx.low+mx.high))
 	{
-		int cols=total_cols;
-		int rows=total_lines;
-		winched=0;
+		x=mx_get(i);
 
-		if (!tty_sz(0))
-		{
-			if ((cols!=total_cols)||(rows!=total_lines))
-			{
-				return ctrl_w;
-			}
-		}
+		return (x < lim) ? x : -1;
+	}
+
+	if (x < mx.done) x=mx.done;
+
+	while (x < lim)
+	{
+		if (mx_match(x))
+		{
+			return x;
+		}
+
+		x++;
+	}
+
+	return -1;
+}
+
+static void mx_cut(ed_off p,ed_off r)
+{
+	/* before r bytes at p are replaced, drop the matches that
+		touch them, or are next to them for whole words */
+	int w=mx.word;
+	ed_off lo=p-mx.len+1-w;
+
+	mx.cut=-1;
+
+	if (!mx.at) return;
+
+	if (lo < 0) lo=0;
+
+	if (lo >= mx.done)
+	{
+		/* nothing indexed is touched, but the part counted from
+			the end would move */
+		mx_gap(mx.done);
+		return;
+	}
+
+	mx_gap(lo);
+
+	while (mx.high && (mx_get(mx.low) < (p+r+w)))
+	{
+		mx.high--;
+	}
+
+	if (mx.done <= (p+r+w))
+	{
+		mx.done=lo;
+	}
+	else
+	{
+		mx.done-=r;
+		mx.cut=lo;
+	}
+}
+
+static void mx_add(ed_off p,ed_off a)
+{
+	/* after a bytes went in at p, look for matches again */
+	if (mx.cut >= 0)
+	{
+		mx.done+=a;
+		mx_scan(mx.cut,p+a+mx.word);
+		mx.cut=-1;
+	}
+}
+#endif
+
+static void ed_del(ed_off hwmany)
+{
+	ADBG_DEL(hwmany)
+
+	ed_tzap();
+
+	/* delete number of chars */
+	if (hwmany)
+	{
+#ifdef UNDO_LOG
+		if (hwmany > 0)
+		{
+			ud_del(ed_pos(),hwmany);
+		}
+		else
+		{
+			ud_del(ed_pos()+hwmany,-hwmany);
+		}
+#endif
+#ifdef JOURNAL
+		if (hwmany > 0)
+		{
+			jn_del(ed_pos(),hwmany);
+		}
+		else
+		{
+			jn_del(ed_pos()+hwmany,-hwmany);
+		}
+#endif
+#ifdef DIRTY_SAVE
+		if (hwmany > 0)
+		{
+			dx_del(ed_pos(),hwmany);
+		}
+		else
+		{
+			dx_del(ed_pos()+hwmany,-hwmany);
+		}
+#endif
+#ifdef FIND_INDEX
+		if (hwmany > 0)
+		{
+			mx_cut(ed_pos(),hwmany);
+		}
+		else
+		{
+			mx_cut(ed_pos()+hwmany,-hwmany);
+		}
+#endif
+
+		if (hwmany > 0)
+		{
+			/* delete forward characters */
+
+			if (hwmany > cur_file.high_size)
+			{
+#ifdef SPILL_COMPACT
+				ed_cfin();
+#endif
+				hwmany-=cur_file.high_size;
+				cur_file.high_size=0;
+				cur_file.t_hip+=hwmany;
+				cur_file.t_hil-=hwmany;
+			}
+			else
+			{
+				cur_file.high_size-=(long)hwmany;
+			}
+		}
+		else
+		{
+			hwmany=(-hwmany);
+
+			if (hwmany > cur_file.low_size)
+			{
+				hwmany-=cur_file.low_size;
+				cur_file.low_size=0;
+				cur_file.t_lol-=hwmany;
+			}
+			else
+			{
+				cur_file.low_size-=(long)hwmany;
+			}
+
+			/* delete backward characters */
+		}
+
+#ifdef FIND_INDEX
+		mx_add(ed_pos(),0);
+#endif
+	}
+}
+
+static void ed_ins(int ch)
+{
+	/* add character at cursor position */
+
+	ADBG_INS(ch)
+
+	ed_tzap();
+
+#ifdef FIND_INDEX
+	mx_cut(ed_pos(),0);
+#endif
+
+	while (forever)
+	{
+		if ((cur_file.low_size+cur_file.high_size) < cur_file.buf_size)
+		{
+			cur_file.buffer[cur_file.low_size++]=(char)ch;
+			break;
+		}
+		else
+		{
+			long l=1;
+			if (ed_reserve(l))
+			{
+#if defined(_WIN32) && defined(_M_IX86)
+				__asm int 3;
+#endif
+			}
+
+			/* try and keep mid buffer */
+			if (cur_file.high_size > cur_file.low_size)
+			{
+				l=cur_file.high_size;
+				l>>=1;
+				ed_dump(l);
+			}
+			else
+			{
+				l=cur_file.low_size;
+				l>>=1;
+				ed_dump(-l);
+			}
+		}
+	}
+
+#ifdef FIND_INDEX
+	mx_add(ed_pos()-1,1);
+#endif
+#ifdef UNDO_LOG
+	ud_ins(ed_pos()-1,1);
+#endif
+#ifdef JOURNAL
+	jn_ins(ed_pos()-1,1);
+#endif
+#ifdef DIRTY_SAVE
+	dx_ins(ed_pos()-1,1);
+#endif
+}
+
+static void ed_insn(char *p,long n)
+{
+	/* add n characters at the cursor position */
+	ed_off at=ed_pos();
+
+	ADBG_MINS(p,n)
+
+	ed_tzap();
+
+#ifdef FIND_INDEX
+	mx_cut(at,0);
+#endif
+
+	while (n)
+	{
+		long l=cur_file.buf_size-cur_file.low_size-cur_file.high_size;
+
+		if (l)
+		{
+			if (l > n) l=n;
+
+			memcpy(cur_file.buffer+cur_file.low_size,p,l);
+			cur_file.low_size+=l;
+			p+=l;
+			n-=l;
+		}
+		else if (cur_file.low_size)
+		{
+			/* more is coming after it, so all of it goes */
+			ed_dump(-cur_file.low_size);
+		}
+		else
+		{
+			ed_dump(cur_file.high_size);
+		}
+	}
+
+#ifdef FIND_INDEX
+	mx_add(at,ed_pos()-at);
+#endif
+#ifdef UNDO_LOG
+	ud_ins(at,ed_pos()-at);
+#endif
+#ifdef JOURNAL
+	jn_ins(at,ed_pos()-at);
+#endif
+#ifdef DIRTY_SAVE
+	dx_ins(at,ed_pos()-at);
+#endif
+}
+
+static void ed_dump(long p)
+{
+	/* move bytes out of buffer into file,
+		-v means low part, +ve means high part */
+
+	ed_tzap();
+
+#ifdef SPILL_COMPACT
+	ed_cfin();
+#endif
+
+	if (p)
+	{
+		char *p1,*p2;
+		long l;
+
+		if (p > 0)
+		{
+#ifdef _DEBUG
+			printf("dumping %ld from top\n",p);
+#endif
+			/* move buffer to top half file */
+
+			if (p > cur_file.high_size)
+			{
+				p=cur_file.high_size;
+			}
+
+			if (p)
+			{
+				ed_reserve(p);
+
+#ifdef _DEBUG
+				if ((cur_file.t_lol+p)>cur_file.t_hip)
+				{
+					/* not enough room in temp */
+#if defined(_WIN32) && defined(_M_IX86)
+					__asm int 3;
+#endif
+				}
+
+				printf("room is %ld\n",(long)(cur_file.t_hip-cur_file.t_lol));
+				printf("actually dumping %ld\n",p);
+				printf("high size is %ld\n",cur_file.high_size);
+#endif
+				cur_file.t_hip-=p;
+				cur_file.t_hil+=p;
+
+				p1=cur_file.buffer;
+				p1+=cur_file.buf_size;
+				p1-=p /*cur_file.high_size*/;
+
+				ed_write(cur_file.t_hip,p1,p);
+
+				cur_file.high_size-=p;
+
+				p1=cur_file.buffer+cur_file.buf_size;
+				p2=p1-p;
+
+				l=cur_file.high_size;
+				while (l--)
+				{
+					*--p1=(*--p2);
+				}
+			}
+		}
+		else
+		{
+			p=(-p);
+
+#ifdef _DEBUG
+			printf("dumping %ld from bottom\n",p);
+#endif
+
+			ed_reserve(p);
+
+#ifdef _DEBUG
+			if ((cur_file.t_lol+p)>cur_file.t_hip)
+			{
+#if defined(_WIN32) && defined(_M_IX86)
+				__asm int 3;
+#endif
+			}
+#endif
+
+			/* move buffer to bottom half file */
+
+			if (p > cur_file.low_size)
+			{
+				p=cur_file.low_size;
+			}
+
+			if (p)
+			{
+				ed_write(cur_file.t_lol,cur_file.buffer,p);
+
+				p1=cur_file.buffer;
+				p2=cur_file.buffer+p;
+
+				cur_file.low_size-=p;
+				cur_file.t_lol+=p;
+
+				l=cur_file.low_size;
+
+				while (l--)
+				{
+					*p1++=(*p2++);
+				}
+			}
+		}
+	}
+	else
+	{
+		/* flush entire buffer */
+
+		p=cur_file.low_size + cur_file.high_size;
+
+#ifdef _DEBUG
+		printf("dumping entire %ld buffer\n",p);
+#endif
+
+		if (ed_reserve(p))
+		{
+#if defined(_WIN32) && defined(_M_IX86)
+			__asm int 3;
+#endif
+		}
+
+		if (cur_file.low_size)
+		{
+			ed_dump(-cur_file.low_size);
+		}
+
+		if (cur_file.high_size)
+		{
+			ed_dump(cur_file.high_size);
+		}
+	}
+}
+
+static ed_off ed_pos(void)
+{
+	return cur_file.low_size+cur_file.t_lol;
+}
+
+static void ed_seof(ed_off l)
+{
+	while (forever)
+	{
+		ed_off m,e;
+		char buf[512];
+
+		m=sizeof(buf);
+
+		while (m--) buf[m]=0;
+
+#ifdef TEMP_FP
+		ed_fseek(cur_file.t_fp,0L,SEEK_END);
+		e=ed_ftell(cur_file.t_fp);
+#else
+		e=lseek(cur_file.t_fd,0L,SEEK_END);
+#endif
+
+		m=l-e;
+
+		if (m <= 0) 
+		{
+			if (m < 0)
+			{
+				perror("seof");
+				tty_reset(0);
+				exit(1);
+			}
+
+#ifdef TEMP_FP
+			fflush(cur_file.t_fp);
+#endif
+			break;
+		}
+
+#ifdef HAVE_FTRUNCATE
+		/* grow sparse, the new space is always written before it is read */
+		if (!ftruncate(ed_fd(),l))
+		{
+#ifdef HAVE_MMAP
+			cur_file.t_mstale=1;
+#endif
+			continue;
+		}
+#endif
+
+		if (m > sizeof(buf))
+		{
+			m=sizeof(buf);
+		}
+
+		ed_write(e,buf,(long)m);
+	}
+}
+
+static int ed_reserve(ed_off l)
+{
+	ed_tzap();
+
+#ifdef SPILL_COMPACT
+	ed_cfin();
+#endif
+
+	if (!l) return 0;
+
+	l-=(cur_file.t_hip - cur_file.t_lol);
+
+	if (l <= 0 )
+	{
+		/* enough space in file */
+
+		return 0;
+	}
+
+#ifdef _DEBUG
+	printf("ed_reserve %ld bytes\n",(long)l);
+#endif
+
+	ed_seof(l+cur_file.t_hip+cur_file.t_hil);
+
+	if (cur_file.t_hil)
+	{
+		/* have to shuffle up the high portion */
+
+		ed_off n=cur_file.t_hil;
+		ed_off src=cur_file.t_hil+cur_file.t_hip;
+		ed_off tgt=src+l;
+
+#ifdef _DEBUG
+		printf("shuffle(n=%ld,l=%ld)\n",(long)n,(long)l);
+#endif
+
+		while (n)
+		{
+			char buf[512];
+			long m=sizeof(buf);
+
+			if (n < m)
+			{
+				m=(long)n;
+			}
+
+			src-=m;
+			tgt-=m;
+			n-=m;
+
+			ed_read(src,buf,m);
+			ed_write(tgt,buf,m);
+		}
+	}
+
+	cur_file.t_hip+=l;
+
+	return 0;
+}
+
+#ifdef SPILL_COMPACT
+static void ed_cmove(ed_off n)
+{
+	/* move the next n bytes of the high part down to the compaction destination */
+	char buf[4096];
+
+	while (n)
+	{
+		long m=sizeof(buf);
+
+		if (n < m)
+		{
+			m=(long)n;
+		}
+
+		ed_read(cur_file.t_hip+cur_file.t_cmv,buf,m);
+		ed_write(cur_file.t_cdst+cur_file.t_cmv,buf,m);
+
+		cur_file.t_cmv+=m;
+		n-=m;
+	}
+}
+
+static void ed_cend(void)
+{
+	/* high part is now contiguous at the destination, drop the tail */
+	cur_file.t_hip=cur_file.t_cdst;
+	cur_file.t_cmv=0;
+
+#ifdef TEMP_FP
+	fflush(cur_file.t_fp);
+#endif
+
+#ifdef HAVE_MMAP
+	ed_unmap();
+#endif
+
+#ifdef SAVE_THREAD
+	sv_hold(cur_file.t_hip+cur_file.t_hil,-1);
+#endif
+
+	if (ftruncate(ed_fd(),cur_file.t_hip+cur_file.t_hil))
+	{
+		perror("compact");
+		tty_reset(0);
+		exit(1);
+	}
+
+	ed_tzap();
+}
+
+static int ed_compact(void)
+{
+	/* one slice of spill file compaction,
+		returns non zero while there is more to do */
+	ed_off n;
+
+#ifdef SAVE_THREAD
+	if (sv_need(0,-1))
+	{
+		/* a save is still reading the temp file */
+		return 0;
+	}
+#endif
+
+	if (!cur_file.t_cmv)
+	{
+		ed_off dead=cur_file.t_hip-cur_file.t_lol;
+
+		if ((dead < COMPACT_MIN) || (dead < (cur_file.t_lol+cur_file.t_hil)))
+		{
+			return 0;
+		}
+
+		/* leave a buffer's worth of gap so the next dump fits */
+		cur_file.t_cdst=cur_file.t_lol+cur_file.buf_size;
+
+		if (!cur_file.t_hil)
+		{
+			ed_cend();
+
+			return 0;
+		}
+	}
+
+	n=cur_file.t_hil-cur_file.t_cmv;
+
+	if (n > COMPACT_STEP)
+	{
+		n=COMPACT_STEP;
+	}
+
+	ed_cmove(n);
+
+	if (cur_file.t_cmv < cur_file.t_hil)
+	{
+		return 1;
+	}
+
+	ed_cend();
+
+	return 0;
+}
+
+static void ed_cfin(void)
+{
+	/* the engine is about to rearrange the spill file, if nothing
+		has been overwritten yet forget the compaction, otherwise
+		complete it */
+
+	if (cur_file.t_cmv)
+	{
+		if ((cur_file.t_cdst+cur_file.t_cmv) <= cur_file.t_hip)
+		{
+			cur_file.t_cmv=0;
+		}
+		else
+		{
+			ed_cmove(cur_file.t_hil-cur_file.t_cmv);
+			ed_cend();
+		}
+	}
+}
+#endif
+
+#ifdef FRAME_MS
+static void co_putc(int c)
+{
+	if (!fr.held)
+	{
+		putchar(c);
+	}
+}
+#else
+#	define co_putc(c)	putchar(c)
+#endif
+
+static void co_puts(char *p)
+{
+	while (*p) co_putc(*p++);
+}
+
+static int tty_sz(int fd)
+{
+#ifdef TIOCGWINSZ
+	struct winsize ws;
+	ws.ws_row=ws.ws_col=0;
+	if (!ioctl(fd,TIOCGWINSZ,&ws))
+	{
+		if ((ws.ws_col > 10) & (ws.ws_row > 4))
+		{
+			total_cols=ws.ws_col;
+			total_lines=ws.ws_row;
+			if (total_lines > max_lines) total_lines=max_lines;
+			return 0;
+		}
+	}
+#endif /* TIOCGWINSZ */
+
+#ifdef _WIN32
+	{
+		int cols,rows;
+		if (!tty_winsize(&cols,&rows))
+		{
+			total_cols=cols;
+			total_lines=rows;
+			if (total_lines > max_lines) total_lines=max_lines;
+			return 0;
+		}
+	}
+#endif
+
+#ifdef ANSI_SYS
+#	ifdef PLOT_CTRL
+	/* plot cursor at bottom right and ask for the position */
+/*	co_puts("\033[127;127H\033[6n");*/
+	guessing=1;
+	co_puts("\033[127;127H\033[6n");
+	fflush(stdout);
+	if (ctrl_w==getkey())
+	{
+		return 0;
+	}
+#	endif /* PLOT_CTRL */
+#else /* ANSI_SYS */
+#	ifdef _WIN32
+	co_puts("\033[?2l");
+	total_lines=25;
+#	endif /* _WIN32 */
+	guessing=1;
+	co_puts("\033Z");
+	fflush(stdout);
+	if (ctrl_w==getkey())
+	{
+		return 0;
+	}
+#endif /* ANSI_SYS */
+
+	return -1;
+}
+
+/* last byte of ESC x, ESC [ x and ESC O x */
+static struct
+{
+	int c,k;
+} key_last[]={
+	{'A',key_up},
+	{'B',key_down},
+	{'C',key_right},
+	{'D',key_left},
+	{'P',escape},
+	{0,0}
+};
+
+/* ESC [ n ~ */
+static int key_tilde[]={0,key_find,key_ins,key_del,key_sel,page_up,page_down};
+
+static int key_seq(int c)
+{
+	int i;
+
+	for (i=0; key_last[i].c; i++)
+	{
+		if (key_last[i].c==c)
+		{
+			return key_last[i].k;
+		}
+	}
+
+	return 0;
+}
+
+static int getkey(void)
+{
+	int k;
+
+#ifdef _DEBUG
+	dumpinfo();
+#endif
+
+	if (winched)
+	{
+		int cols=total_cols;
+		int rows=total_lines;
+		winched=0;
+
+		if (!tty_sz(0))
+		{
+			if ((cols!=total_cols)||(rows!=total_lines))
+			{
+				return ctrl_w;
+			}
+		}
 	}
 
 	switch (k=co_getch()) 
 	{
-	case escape:
-		switch (k=co_getch()) 
+	case escape:
+#ifdef ESC_DELAY
+		if (!co_ready(esc_delay))
+		{
+			/* nothing followed it so it was the ESC key */
+			break;
+		}
+#endif
+		switch (k=co_getch()) 
+		{
+		case '/':
+			k=co_getch();
+			k=ctrl_w;
+			guessing=0;	/* VT52 response, last should have been 'Z' */
+			break;
+		case 'O':
+		case '[':
+			{
+				int index=10;
+				int args[10];
+
+				while (index)
+				{
+					index--;
+					args[index]=0;
+				}
+
+				do
+				{
+					k=co_getch();
+
+					switch (k) 
+					{
+						case '~':
+							k=escape;
+							if ((args[0] > 0) && (args[0] < (int)(sizeof(key_tilde)/sizeof(key_tilde[0]))))
+							{
+								k=key_tilde[args[0]];
+							}
+#ifdef PASTE_WAIT
+							if ((args[0]==200) || (args[0]==201))
+							{
+								/* bracketed paste, whoever wants the
+									text as one piece reads it after this */
+								pasting=(args[0]==200);
+								k=-1;
+							}
+#endif
+							break;
+						case ';':
+							index++;
+							k=0;
+							break;
+						case 'R':
+							total_lines=args[0];
+							total_cols=args[1];
+							k=ctrl_w;
+							guessing=0;
+							break;
+						case 'c':
+							k=ctrl_w;
+							break;
+						default:
+							if ((k >= '0') & (k <= '9'))
+							{
+								args[index]*=10;
+								args[index]+=(k-'0');
+								k=0;
+							}
+							else if (k >= 0)
+							{
+								k=key_seq(k);
+							}
+							break;
+					}
+
+				} while (k==0);
+			}
+			break;
+		default:
+			if (key_seq(k))
+			{
+				k=key_seq(k);
+			}
+#ifdef ESC_DELAY
+			else if (k >= 0)
+			{
+				/* ESC then a key of its own */
+				co_ungetch(k);
+				k=escape;
+			}
+#endif
+			break;
+		}
+		break;
+	case ctrl_s:	
+		k=key_left; 
+		break;
+	case ctrl_d:	
+		k=key_right; 
+		break;
+	case ctrl_x:	
+		k=key_down; 
+		break;
+	case ctrl_e:	
+		k=key_up; 
+		break;
+	case ctrl_q:
+		k=key_home;
+		break;
+	case ctrl_p:
+	case ctrl_u:
+	case ctrl_r:
+		k=page_up; 
+		break;
+	case ctrl_c:
+	case ctrl_n:	
+		k=page_down; 
+		break;
+#ifdef INTELLEC
+	case 0x1e:	
+		k=key_up; 
+		break;
+	case 0x1c:	
+		k=key_down; 
+		break;
+	case 0x14:	
+		k=key_right; 
+		break;
+	case 0x1f:	
+		k=key_left; 
+		break;
+	case 0x1d:	
+		k=key_home; 
+		break;
+#else
+#ifndef QNX
+	case 0x1e:	
+		k=key_up; 
+		break;
+#endif
+	case 0x1f:	
+		k=key_down; 
+		break;
+	case 0x1c:	
+		k=key_left; 
+		break;
+	case 0x1d:	
+		k=key_right; 
+		break;
+#endif
+	case 0xa3:	
+		k&=0x7f; 
+		break;
+	}
+
+	if (!k) 
+	{
+		switch (k=co_getch()) 
+		{
+		case 0x3b: 
+			k=escape; 
+			break;
+		case 0x47: 
+			k=key_start; 
+			break;
+		case 0x48: 
+			k=key_up; 
+			break;
+		case 0x49: 
+			k=page_up; 
+			break;
+		case 0x4B: 
+			k=key_left; 
+			break;
+		case 0x4C: 
+			k=key_home; 
+			break;
+		case 0x4D: 
+			k=key_right; 
+			break;
+		case 0x4F: 
+			k=key_end; 
+			break;
+		case 0x50: 
+			k=key_down; 
+			break;
+		case 0x51: 
+			k=page_down; 
+			break;
+		case 0x52: 
+			k=key_ins; 
+			break;
+		case 0x53: 
+			k=key_del; 
+			break;
+		}
+	}
+
+	if (k==key_home) 
+	{
+		switch (k=getkey()) 
+		{
+		case key_up: 
+			k=page_up; 
+			break;
+		case key_down: 
+			k=page_down; 
+			break;
+		case key_left: 
+			k=key_start; 
+			break;
+		case key_right: 
+			k=key_end; 
+			break;
+		case key_home: 
+			k=escape; 
+			break;
+		}
+	}
+
+#ifdef FRAME_MS
+	if (fr.held && !fr_moves(k))
+	{
+		/* whatever this key does starts from what is really there */
+		fr_show();
+	}
+#endif
+
+	return k;
+}
+
+static void co(int c)
+{
+	int i;
+	switch (c) 
+	{
+	case nl:
+		co_putc(13);
+		co_putc(c);
+		tty_col=0;
+		tty_row++;
+		break;
+	default:
+#ifndef REVERSE
+		if (rev_on==2) c='#';
+#endif
+		if (c<32) c='?'; 
+		else if (c>126) c='?';
+		co_putc(c);
+		tty_col++;
+		if ((c!=' ') | rev_on) 
+		{
+			if (tty_col > chars_per_line[tty_row]) 
+			{
+				chars_per_line[tty_row]=tty_col;
+			}
+		}
+		if (tty_col > last_col) 
+		{ 
+			if (wordwrap) 
+			{
+				tty_col=0; 
+				tty_row++;
+			} 
+			else 
+			{
+				tty_col=last_col;
+			}
+		}
+		break;
+	}
+	if (tty_row > menu_line) 
+	{
+		tty_row=menu_line;
+		i=0;
+		while (i < menu_line) 
+		{
+			chars_per_line[i]=chars_per_line[i+1];
+			i++;
+		}
+		chars_per_line[menu_line]=0;
+		menu_erased=1;
+	}
+}
+
+static void co_str(char *p)
+{
+	while (*p) co(*p++);
+}
+
+static int next_tab(int i)
+{
+	i/=tabs;
+	i++;
+	i*=tabs;
+	return i;
+}
+
+static int next_col(int c,int ch)
+{
+	if (ch==nl) return 0;
+	if (ch==tab) return next_tab(c);
+	if (c>=last_col) 
+	{
+		return 0;
+	}
+	return (c+1);
+}
+
+static char *sprintn(ed_off u,char *p)
+{
+	ed_off v;
+
+	v=u/10;
+	if (v) p=sprintn(v,p);
+	v=u%10;
+	*p++=(char)('0'+v);
+	*p=0;
+	return p;
+}
+
+static void printn(ed_off u)
+{
+	char buf[24];
+	sprintn(u,buf);
+	co_str(buf);
+}
+
+static void reverse(int i)
+{
+	if (!(rev_on | i)) return;
+
+	if (i==4) return;
+
+	rev_on=i;
+#ifdef REVERSE
+#ifdef ANSI_SYS
+	if (i) 
+	{
+		co_puts("\033[7m");
+	} 
+	else 
+		{
+		co_puts("\033[0m");						 /* was 0 */
+	}
+#else /* ANSI_SYS */
+	if (i) 
+	{
+		co_puts("\033(");
+	} 
+	else 
+		{
+		co_puts("\033)");
+	}
+#endif /* ANSI_SYS */
+#else /* REVERSE */
+	if (rev_on==3) 
+	{
+		if ((mode=='b')|(mode=='d')) rev_on=2;
+	}
+#endif /* REVERSE */
+}
+
+#ifdef FIND_INDEX
+static void underline(int i)
+{
+#ifdef ANSI_SYS
+	co_puts(i ? "\033[4m" : "\033[0m");
+#endif
+}
+#endif
+
+static void clear_line(void)
+{
+	int rev,i,j,k;
+
+	rev=rev_on;
+	if (rev) reverse(0);
+
+	j=i=tty_col;
+	k=tty_row;
+
+	if (chars_per_line[k] > i) i=chars_per_line[k];
+	if (k>=menu_line) 
+	{
+		if (i>last_col) i=last_col;
+		if (j>last_col) j=last_col;
+	}
+	i-=j;
+#ifdef ERASE_LINE
+	if (i) 
+	{
+#ifdef ANSI_SYS
+		co_puts("\033[K");
+#else /* ANSI_SYS */
+		co_puts("\033K");
+#endif /* ANSI_SYS */
+	}
+#else /* ERASE_LINE */
+	while (i--) co(' ');
+#endif /* ERASE_LINE */
+	
+	chars_per_line[k]=j;
+
+	if (rev) reverse(rev);
+}
+
+#ifdef PLOT_CTRL
+static void plot_ctrl(int r,int c)
+{
+	char plot_buf[20];
+#ifdef ANSI_SYS
+	char num_buf[10];
+
+	strcpy(plot_buf,"\033[");
+	sprintn((long)(r+1),num_buf);
+	strcat(plot_buf,num_buf);
+	strcat(plot_buf,";");
+	sprintn((long)(c+1),num_buf);
+	strcat(plot_buf,num_buf);
+	strcat(plot_buf,"H");
+#else /* ANSI_SYS */
+	char *p;
+	p=plot_buf;
+	*p++=(char)0x1b;
+	*p++=(char)'Y';
+	*p++=(char)32+r;
+	*p++=(char)32+c;
+	*p=0;
+#endif /* ANSI_SYS */
+	co_puts(plot_buf);
+	tty_row=r; 
+	tty_col=c;
+}
+#endif
+
+#ifndef PLOT_CTRL
+int mag(i)
+int i;
+{
+	if (i<0) return -i;
+	return i;
+}
+#endif /* PLOT_CTRL */
+
+#ifdef SCROLL_RGN
+static void scrol_rgn(int r,int c)
+{
+	char scr_buf[20];
+	char num_buf[10];
+
+	strcpy(scr_buf,"\033[");
+	if (r != -1)
+	{
+		sprintn((long)(r+1),num_buf);
+		strcat(scr_buf,num_buf);
+	}
+	strcat(scr_buf,";");
+	if (c != -1)
+	{
+		sprintn((long)(c+1),num_buf);
+		strcat(scr_buf,num_buf);
+	}
+	strcat(scr_buf,"r");
+	co_puts(scr_buf);
+	tty_row=(-1); 
+	tty_col=(-1);
+	plot_ctrl(0,0);
+}
+#endif
+
+static void plot(int r,int c)
+{
+	if ((tty_row==r)&(tty_col==c)) return;
+
+#ifndef PLOT_CTRL
+	{
+		int x,y;
+
+		if ((!c) & (r>tty_row)) co(nl);
+
+		x=mag(tty_col-c);
+		y=mag(tty_row-r);
+
+		if ((x+y) > (c+r)) home();
+
+		while (r > tty_row) cud();
+		while (r < tty_row) cuu();
+		while (c > tty_col) cuf();
+		while (c < tty_col) cub();
+	}
+#else /* PLOT_CTRL */
+	plot_ctrl(r,c);
+#endif /* PLOT_CTRL */
+}
+
+static void show_block(ed_off q,ed_off i,int endrow)
+{
+	if (row >= endrow) return;
+
+	while (i--) 
+	{
+		int c;
+
+		c=ed_at(q++);
+
+		if (c==nl) 
+		{
+			clear_line();
+			row++;
+			plot(row,0);
+			col=0;
+			if (row>=endrow) return;
+		} 
+		else 
+			{
+			if (c==tab) 
+			{
+				int j;
+				j=next_tab(col)-col;
+				while (j--) 
+				{
+					co(' ');
+					col++;
+				}
+			} 
+			else 
+			{
+				co(c);
+				col++;
+			}
+			if (col > last_col) 
+			{ 
+				col=0;
+				row++;
+#ifdef PLOT_CTRL
+				plot(row,col);
+#else
+				if (!wordwrap) plot(row,col);
+#endif
+				if (row>=endrow) return;
+			}
+		}
+	}
+}
+
+#ifdef FIND_INDEX
+static void show_marks(ed_off q,ed_off l,int endrow)
+{
+	/* show_block with the matches of the find string underlined */
+	ed_off e=q+l;
+
+	if (!mx.at)
+	{
+		show_block(q,l,endrow);
+		return;
+	}
+
+	while ((q < e) && (row < endrow))
+	{
+		ed_off u=q,s=q-mx.len+1;
+
+		/* how far the run of matches covering q goes */
+		while ((u < (q+MX_PAINT)) && ((s=mx_next(s,(u > q) ? u : q+1)) >= 0))
+		{
+			if ((s+mx.len) > u) u=s+mx.len;
+			s++;
+		}
+
+		if (u > q)
+		{
+			if (u > e) u=e;
+			underline(1);
+			show_block(q,u-q,endrow);
+			underline(0);
+		}
+		else
+		{
+			ed_off w=q+MX_PAINT;
+
+			if (w > e) w=e;
+
+			u=mx_next(q+1,w);
+
+			if (u < 0) u=w;
+
+			show_block(q,u-q,endrow);
+		}
+
+		q=u;
+	}
+}
+#else
+#	define show_marks(q,l,r)	show_block(q,l,r)
+#endif
+
+static void show_text(ed_off pos,ed_off len,int endrow)
+{
+	ed_off inv_start,inv_end,k,l;
+
+	inv_start=inv_end=0;
+	if (sel_on) 
+	{
+		inv_start=sel_pos;
+		inv_end=ed_pos();
+		if (inv_start > inv_end) 
+		{
+			inv_start=ed_pos();
+			inv_end=sel_pos;
+		}
+	}
+	k=pos+len;
+	if (inv_start < pos) inv_start=pos;
+	if (inv_start > k) inv_start=k;
+	if (inv_end < pos) inv_end=pos;
+	if (inv_end > k) inv_end=k;
+
+	l=inv_start-pos;
+	if (l) show_marks(pos,l,endrow);
+	l=inv_end-inv_start;
+	if (l) 
+	{
+		reverse(3);
+		show_block(inv_start,l,endrow);
+		reverse(0);
+	}
+	l=k-inv_end;
+	if (l) show_marks(inv_end,l,endrow);
+}
+
+static void show_top(void)
+{
+	row=col=0;
+	plot(row,col);
+	show_text(page_start,ed_pos()-page_start,status_line);
+	crsr_row=row;
+	crsr_col=col;
+}
+
+static void show_bottom(int erase_after)
+{
+	plot(row=crsr_row,col=crsr_col);
+	show_text(ed_pos(),ed_len()-ed_pos(),status_line);
+	/*	if (row < status_line) co('|');*/
+	if (erase_after) 
+	{
+		if (row < status_line) clear_line();
+
+		row++;
+
+		while (row < status_line) 
+		{
+			if (chars_per_line[row])
+			{
+				plot(row,0);
+				clear_line();
+			}
+			/*		co_str("\n");*/
+			row++;
+		}
+	}
+	if (erase_after != 2) plot(row=crsr_row,col=crsr_col);
+	fflush(stdout);
+}
+
+static void scan_pos(ed_off i)
+{
+	ed_off p=page_start;
+	row=col=0;
+	while (i--) 
+	{
+		int c;
+		if (p >= ed_len()) 
+		{
+			return;
+		}
+
+		c=ed_at(p++);
+
+		col=next_col(col,c);
+
+		if (col==0)
+		{
+			row++;
+
+			if (row >= status_line)
+			{
+				return;
+			}
+		}
+	}
+}
+
+static void paint_text(ed_off len)
+{
+	ed_off i;
+
+	if (len==0) return;
+
+	if (len < 0) 
+	{
+		i=ed_pos()+len;
+		if (i < page_start) i=page_start;
+		i-=page_start;
+		scan_pos(i);
+		plot(row,col);
+		show_text(page_start+i,ed_pos()-page_start-i,status_line);
+	} 
+	else 
+	{
+		scan_pos(ed_pos()-page_start);
+		plot(row,col);
+		show_text(ed_pos(),len,status_line);
+	}
+}
+
+static void ed_fmove(ed_off i)
+{
+#ifdef _DEBUG
+	if (cur_file.low_size+cur_file.high_size)
+	{
+#if defined(_WIN32) && defined(_M_IX86)
+		__asm int 3
+#endif
+	}
+	printf("ed_fmove(%ld)\n",(long)i);
+#endif
+
+#ifdef SPILL_COMPACT
+	ed_cfin();
+#endif
+
+	if (i)
+	{
+		if (i > 0)
+		{
+			/* move higher to lower */
+
+#ifdef _DEBUG
+			if (i > cur_file.t_hil)
+			{
+#if defined(_WIN32) && defined(_M_IX86)
+				__asm int 3;
+#endif
+			}
+#endif
+			while (i)
+			{
+				long l=cur_file.buf_size;
+
+				if (i < l)
+				{
+					l=(long)i;
+				}
+
+				ed_read(cur_file.t_hip,cur_file.buffer,l);
+
+				cur_file.t_hip+=l;
+				cur_file.t_hil-=l;
+
+				ed_write(cur_file.t_lol,cur_file.buffer,l);
+
+				cur_file.t_lol+=l;
+
+				i-=l;
+			}
+		}
+		else
+		{
+			i=(-i);
+
+#ifdef _DEBUG
+			if (i > cur_file.t_lol)
+			{
+#if defined(_WIN32) && defined(_M_IX86)
+				__asm int 3;
+#endif
+			}
+#endif
+
+			/* move lower to higher */
+
+			while (i)
+			{
+				long l=cur_file.buf_size;
+
+				if (i < l)
+				{
+					l=(long)i;
+				}
+
+				ed_read(cur_file.t_lol-l,cur_file.buffer,l);
+
+				cur_file.t_lol-=l;
+
+				ed_write(cur_file.t_hip-l,cur_file.buffer,l);
+
+				cur_file.t_hip-=l;
+				cur_file.t_hil+=l;
+				i-=l;
+			}
+		}
+	}
+}
+
+static void ed_move(ed_off i)
+{
+	/* if +ve add text to lower section, else move to upper half */
+
+	ADBG_POS(ed_pos());
+	ADBG_LEN(ed_len());
+
+	ADBG_MOVE(i)
+
+	if (view_only)
+	{
+		/* the file is the whole document, just slide the empty gap */
+		cur_file.t_lol+=i;
+		cur_file.t_hip+=i;
+		cur_file.t_hil-=i;
+
+		return;
+	}
+
+	if (i) 
+	{
+		char *p,*q;
+
+		p=cur_file.buffer;
+		p+=cur_file.low_size;
+		q=cur_file.buffer;
+		q+=(cur_file.buf_size-cur_file.high_size);
+
+		if (i < 0) 
+		{
+			i=(-i);
+
+			if (i > cur_file.low_size)
+			{
+				/* flush memory buffer totally */
+				ed_dump(0L);
+
+				ed_fmove(-i);
+
+				i=ed_room();
+				i>>=1;
+				ed_load((long)i);
+				ed_load((long)-i);
+			}
+			else
+			{
+				cur_file.high_size+=(long)i;
+				cur_file.low_size-=(long)i;
+
+#ifdef _WIN32
+				if (cur_file.high_size < 0)
+				{
+#if defined(_WIN32) && defined(_M_IX86)
+					__asm int 3
+#endif
+				}
+				if (cur_file.low_size < 0)
+				{
+#if defined(_WIN32) && defined(_M_IX86)
+					__asm int 3;
+#endif
+				}
+#endif
+
+				while (i--) *--q=(*--p);
+			}
+		} 
+		else 
+		{
+			if (i > cur_file.high_size)
+			{
+				ed_dump(0L);
+				ed_fmove(i);
+
+				i=ed_room();
+				i>>=1;
+				ed_load((long)i);
+				ed_load((long)-i);
+			}
+			else
+			{
+				cur_file.high_size-=(long)i;
+				cur_file.low_size+=(long)i;
+
+#ifdef _WIN32
+				if (cur_file.high_size < 0)
+				{
+#if defined(_WIN32) && defined(_M_IX86)
+					__asm int 3
+#endif
+				}
+				if (cur_file.low_size < 0)
+				{
+#if defined(_WIN32) && defined(_M_IX86)
+					__asm int 3
+#endif
+				}
+#endif
+
+				while (i--) *p++=(*q++);
+			}
+		}
+	}
+}
+
+static void show_mopt(char **list,int opt)
+{
+int i=0;
+int pm=0;
+
+	plot(menu_line,0);
+
+	while (list[i])
+	{
+		i++;
+	}
+
+	if (opt >= i)
+	{
+		opt=0;
+	}
+
+	while (opt < i)
+	{
+		char *p=list[opt];
+		size_t k=strlen(p);
+
+		if ((tty_col+10+9) > total_cols)
+		{
+			break;
+		}
+
+		opt++;
+
+		co_str("  ");
+		co_str(p);
+		k=10-k-2;
+		while (k--) co(' ');
+		pm++;
+	}
+
+	while (tty_col < (last_col-9))
+	{
+		co(' ');
+	}
+
+	if (pm < i)
+	{
+		menu_nxt=opt;
+		co_str("--more--");
+	}
+	else
+	{
+		menu_nxt=0;
+	}
+
+	while (tty_col < last_col)
+	{
+		co(' ');
+	}
+}
+
+char *menu_d[]={"Again","Block","Count","Delete","Find","-find","Get","Insert","Jump","Length","Multi","Narrow","Options","Quit","Replace","?replace","Shell","Undo","~redo","View","Xchange",NULL};
+char *menu_b[]={"Buffer","Copy","Delete","Put",NULL};
+char *menu_q[]={"Abort","Exit","Init","Update","View","Write",NULL};
+char opt_case[]="Case=y";
+#ifdef FIND_INDEX
+char opt_hilite[]="Hilite=n";
+#endif
+char opt_regex[]="Regex=n";
+char opt_word[]="Word=n";
+char *menu_o[]={
+	opt_case,
+#ifdef FIND_INDEX
+	opt_hilite,
+#endif
+	opt_regex,opt_word,NULL};
+
+static void show_status(void)
+{
+#if defined(_WIN32) && defined(_M_IX86)
+/*	if (!menu_erased)
+	{
+		__asm int 3;
+	}*/
+#endif
+
+	plot(status_line,0);
+
+	menu_erased=0;
+
+	switch (mode) 
+	{
+	case 'i':
+		break;
+	default:
+		co_str(" ---- ");
+		if (filename) 
+		{
+			co_str(filename);
+		} 
+
+		if (view_only)
+		{
+			co_str(" [view]");
+		}
+
+#ifdef FIND_INDEX
+		if ((mx_cur >= 0) && mx_full())
+		{
+			co_str(", match ");
+			printn((ed_off)mx_rank(mx_cur)+1);
+			co_str(" of ");
+			printn((ed_off)(mx.low+mx.high));
+		}
+#endif
+
+		if (ac_hit >= 0)
+		{
+			char *p=ac.pat[ac_hit];
+			int i=32;
+
+			co_str(", found \042");
+
+			while (*p && i--)
+			{
+				co(0xff & *p++);
+			}
+
+			co(0x22);
+		}
+
+		if (mode=='n')
+		{
+			co_str(", line ");
+			printn((ed_off)nv.cur+1);
+			co_str(" of ");
+			printn((ed_off)nv.n);
+		}
+
+		if (count_n >= 0)
+		{
+			co_str(", ");
+			printn(count_n);
+			co_str((count_n==1) ? " match on " : " matches on ");
+			printn(count_lines);
+			co_str((count_lines==1) ? " line" : " lines");
+		}
+/*		else 
+		{
+			co_str("(untitled)");
+		}*/
+
+		if (show_size) 
+		{
+			ed_off i=ed_len();
+	/*		if (i==cur_file.buf_size) 
+			{
+				co(' ');
+				reverse(1);
+				co_str("full");
+				reverse(0);
+			}*/
+			if (filename) co_str(", ");
+			if (show_size==2) 
+			{
+				co_str("saving...");
+			} 
+			else 
+			{
+				printn(i);
+				co_str(" bytes");
+	/*			printn(cur_file.buf_size-i);
+				co_str(" free");*/
+#ifdef HAVE_STRUCT_STAT_ST_BLOCKS
+				{
+					struct stat s;
+
+					if (!view_only && !fstat(ed_fd(),&s))
+					{
+						co_str(", spill ");
+						printn((ed_off)s.st_size);
+						co_str(" bytes, ");
+						printn((ed_off)s.st_blocks*512);
+						co_str(" on disk");
+					}
+				}
+#endif
+			}
+			show_size=0;
+		}
+#ifdef JOB_CANCEL
+		else if (jb.pct >= 0)
+		{
+			co_str(", ");
+			co_str(jb.what);
+			co(' ');
+			printn((ed_off)jb.pct);
+			co('%');
+		}
+#endif
+#ifdef SAVE_THREAD
+		else if (sv_pct() >= 0)
+		{
+			co_str(", saving ");
+			printn((ed_off)sv_pct());
+			co('%');
+		}
+#endif
+	}
+	clear_line();
+	plot(menu_line,0);
+	switch (mode) 
+	{
+	case 'i':
+		co_str("[insert]");
+		break;
+	case 'x':
+		co_str("[exchange]");
+		break;
+	case 'n':
+		co_str("[narrow]");
+		break;
+	case 'b':
+	case 'd':
+		reverse(rev_menu);
+		show_mopt(menu_b,0);
+		reverse(0);
+		break;
+	case 'q':
+		reverse(rev_menu);
+		show_mopt(menu_q,0);
+		reverse(0);
+		break;
+	case 'o':
+		reverse(rev_menu);
+		show_mopt(menu_o,0);
+		reverse(0);
+		break;
+	default:
+		reverse(rev_menu);
+		show_mopt(menu_d,menu_id);
+		reverse(0);
+	}
+	clear_line();
+}
+
+static void cls(void)
+{
+	int i;
+#ifdef ANSI_SYS
+	co_puts("\033[H\033[2J");
+#else
+	co_puts("\033H\033J");
+#endif
+	tty_row=tty_col=i=0;
+	while (i < total_lines) chars_per_line[i++]=0;
+	menu_erased=1;
+}
+
+#ifdef FOLLOW_FILE
+static void follow_close(void)
+{
+	if (follow_ino!=-1)
+	{
+		close(follow_ino);
+		follow_ino=-1;
+	}
+
+	if (follow_fd!=-1)
+	{
+		close(follow_fd);
+		follow_fd=-1;
+	}
+}
+
+static void follow_open(ed_off loaded)
+{
+	/* the first loaded bytes of the file are already in the document */
+	follow_close();
+
+	if (!follow)
+	{
+		return;
+	}
+
+	follow_fd=open(filename,O_RDONLY);
+
+	if (follow_fd==-1)
+	{
+		return;
+	}
+
+	follow_pos=loaded;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	follow_ino=inotify_init();
+
+	if (follow_ino!=-1)
+	{
+		/* the directory too, to hear of a new file taking the name */
+		char *d=strjoin("",filename,NULL);
+		char *p=d ? strrchr(d,'/') : NULL;
+
+		if (p)
+		{
+			p[(p==d) ? 1 : 0]=0;
+		}
+
+		if (!d || (inotify_add_watch(follow_ino,filename,IN_MODIFY)==-1)
+			|| (inotify_add_watch(follow_ino,p ? d : ".",IN_CREATE|IN_MOVED_TO)==-1))
+		{
+			close(follow_ino);
+			follow_ino=-1;
+		}
+
+		if (d) free(d);
+	}
+#endif
+}
+
+static int follow_moved(void)
+{
+	/* whether another file now has the name, as when a log is rotated */
+	struct stat a,b;
+
+	return (follow_fd!=-1) && !fstat(follow_fd,&a) && !stat(filename,&b)
+		&& ((a.st_ino!=b.st_ino) || (a.st_dev!=b.st_dev));
+}
+
+static int follow_read(void)
+{
+	/* append what has been written to the followed file since last time
+		to the end of the document, returns non zero if it grew, or -1
+		when viewing and the file was cut short under the document */
+	struct stat s;
+	ed_off n;
+
+	if ((follow_fd==-1) || fstat(follow_fd,&s))
+	{
+		return 0;
+	}
+
+	n=s.st_size-follow_pos;
+
+	if ((n < 0) && view_only)
+	{
+		/* what the document and its map covered has gone */
+		return -1;
+	}
+
+	if (n <= 0)
+	{
+		/* truncated or rotated, carry on from the new end */
+		follow_pos=s.st_size;
+
+		return 0;
+	}
+
+	if (view_only)
+	{
+		/* the document is the file, it just got longer */
+		cur_file.t_hil+=n;
+		follow_pos+=n;
+		ed_tzap();
+#ifdef HAVE_MMAP
+		cur_file.t_mstale=1;
+#endif
+		return 1;
+	}
+
+#ifdef SPILL_COMPACT
+	ed_cfin();
+#endif
+
+#ifdef DIRTY_SAVE
+	/* the file grew under it */
+	dx_lose();
+#endif
+
+	if (lseek(follow_fd,follow_pos,SEEK_SET)!=follow_pos)
+	{
+		return 0;
+	}
+
+	while (n)
+	{
+		char buf[4096];
+		long m=sizeof(buf);
+		int i;
+
+		if (n < m)
+		{
+			m=(long)n;
+		}
+
+		i=read(follow_fd,buf,m);
+
+		if (i <= 0)
+		{
+			break;
+		}
+
+		/* the end of the spill file is always the end of the document */
+		ed_write(cur_file.t_hip+cur_file.t_hil,buf,i);
+
+		cur_file.t_hil+=i;
+		follow_pos+=i;
+		n-=i;
+	}
+
+	return 1;
+}
+
+static int ed_follow(void)
+{
+	/* the rest of the file, then if it has been rotated what is in the
+		new one, returns -1 when viewing as the document is the old file
+		or one cut short */
+	int r=follow_read();
+
+	if (r < 0)
+	{
+		return r;
+	}
+
+	if (follow_moved())
+	{
+		if (view_only)
+		{
+			return -1;
+		}
+
+		follow_open(0);
+		r|=follow_read();
+	}
+
+	return r;
+}
+#endif
+
+static int init(char *fname,FILE *fptr)
+{
+	int c;
+
+	c=0;
+	while (c < total_lines) chars_per_line[c++]=total_cols;
+
+	if (filename)
+	{
+		free(filename);
+		filename=NULL; 
+	}
+
+	crsr_row=crsr_col=0;
+	cur_file.low_size=0L;
+	page_start=0L;
+	cur_file.high_size=0;
+
+	cur_file.t_hip=0;
+	cur_file.t_hil=0;
+	cur_file.t_lol=0;
+	cur_file.t_calen=0;
+	cur_file.t_capos=0;
+	cur_file.t_cmv=0;
+
+#ifdef FIND_INDEX
+	if (mx.at)
+	{
+		/* start again on the new text */
+		mx.low=0;
+		mx.high=0;
+		mx.done=0;
+		mx.cut=-1;
+	}
+	mx_cur=-1;
+#endif
+
+	if (fname)
+	{
+		filename=strdup(fname);
+	}
+
+#ifdef DIRTY_SAVE
+	dx_lose();
+#endif
+
+#ifdef CLEAR_SCREEN
+	cls();
+#else
+#ifndef ERASE_LINE
+	{
+		int i;
+		i=max_lines << 1;
+		while (i--) co(nl);
+	}
+#else
+	home();
+#endif
+#endif
+	show_status();
+	plot(0,0);
+	fflush(stdout);
+
+	if (!filename) 
+	{
+		show_bottom(1);
+		fflush(stdout);
+		return 0;
+	}
+
+	if (!fptr) 
+	{
+		show_bottom(1);
+		fflush(stdout);
+		return 0;
+	}
+
+	if (view_only)
+	{
+		/* read straight from the file, nothing is copied */
+#ifdef TEMP_FP
+		cur_file.t_fp=fptr;
+		ed_fseek(fptr,0L,SEEK_END);
+		cur_file.t_hil=ed_ftell(fptr);
+#else
+#	ifdef O_BINARY
+		cur_file.t_fd=open(filename,O_RDONLY|O_BINARY);
+#	else
+		cur_file.t_fd=open(filename,O_RDONLY);
+#	endif
+		fclose(fptr);
+		if (cur_file.t_fd!=-1)
+		{
+			cur_file.t_hil=lseek(cur_file.t_fd,0L,SEEK_END);
+		}
+#endif
+#ifdef FOLLOW_FILE
+		follow_open(cur_file.t_hil);
+#endif
+		ed_tzap();
+#ifdef HAVE_MMAP
+		ed_unmap();
+#endif
+		show_size=1;
+		show_status();
+		show_top();
+		show_bottom(1);
+		fflush(stdout);
+		return 0;
+	}
+
+	ed_seof(cur_file.t_hip);
+
+	while (forever)
+	{
+		int i=(int)fread(cur_file.t_cache,1,sizeof(cur_file.t_cache),fptr);
+		if (i > 0)
+		{
+			long l=i;
+			ed_write(cur_file.t_hip+cur_file.t_hil,cur_file.t_cache,l);
+
+			ADBG_MINS(cur_file.t_cache,l)
+
+			cur_file.t_hil+=l;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	ed_tzap();
+
+	fclose(fptr);
+#ifdef DIRTY_SAVE
+	dx_init(filename);
+#endif
+#ifdef FOLLOW_FILE
+	follow_open(cur_file.t_hil);
+#endif
+	ed_move(-ed_pos());
+	ed_load(cur_file.buf_size);
+	show_size=1;
+	show_status();
+	show_top();
+	show_bottom(1);
+	fflush(stdout);
+	return 0;
+}      
+
+static void plot_cursor(void)
+{
+	plot(crsr_row,crsr_col);
+}
+
+#ifdef JOB_CANCEL
+/* a command that can take a while runs as a job, it says now and
+	then how far it has got and gives up if ESC is typed, other keys
+	typed meanwhile are kept for getkey */
+static int jb_keys(int ms)
+{
+	/* 1 if ESC was typed */
+	if (ev_wait(ms,-1) > 0)
+	{
+		char buf[sizeof(key_ahead)];
+		int i,j;
+
+		if (key_iahead==key_nahead)
+		{
+			key_iahead=0;
+			key_nahead=0;
+		}
+
+		i=tty_read(0,buf,sizeof(buf));
+
+		for (j=0; j < i; j++)
+		{
+			if ((buf[j]==escape)
+				&& !(((j+1) < i) && ((buf[j+1]=='[') || (buf[j+1]=='O'))))
+			{
+				/* an ESC not starting a cursor key */
+				jb.stop=1;
+
+				return 1;
+			}
+
+			if (key_nahead < (int)sizeof(key_ahead))
+			{
+				key_ahead[key_nahead++]=buf[j];
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void jb_start(char *what)
+{
+	jb.what=what;
+	jb.tick=0;
+	jb.stop=0;
+	jb.pct=-1;
+	gettimeofday(&jb.t0,NULL);
+}
+
+static int jb_look(ed_off done,ed_off size)
+{
+	/* non zero if the job is to stop, shows the progress once it
+		has run for a while */
+	struct timeval t;
+	int i;
+
+	if (!jb.what)
+	{
+		return 0;
+	}
+
+	if (jb.stop || jb_keys(0))
+	{
+		return 1;
+	}
+
+	if (size <= 0)
+	{
+		return 0;
+	}
+
+	gettimeofday(&t,NULL);
+
+	if (((t.tv_sec-jb.t0.tv_sec)*1000L+(t.tv_usec-jb.t0.tv_usec)/1000) < JOB_SHOW)
+	{
+		return 0;
+	}
+
+	i=(int)((done*100)/size);
+
+	if (i != jb.pct)
+	{
+		jb.pct=i;
+		show_status();
+		plot(menu_line,0);
+		co_str("ESC to stop");
+		clear_line();
+		fflush(stdout);
+		menu_erased=1;
+	}
+
+	return 0;
+}
+
+static int jb_step(ed_off done,ed_off size)
+{
+	/* for loops that go round often, only looks now and then */
+	if ((++jb.tick) & (JOB_TICK-1))
+	{
+		return jb.stop;
+	}
+
+	return jb_look(done,size);
+}
+
+static int jb_end(void)
+{
+	/* non zero if the job was stopped */
+	int i=jb.stop;
+
+	jb.what=NULL;
+	jb.stop=0;
+
+	if (jb.pct >= 0)
+	{
+		jb.pct=-1;
+		menu_erased=1;
+	}
+
+	return i;
+}
+#endif
+
+#ifdef SAFE_WRITE
+static char *wr_temp(char *fn,int *fd)
+{
+	/* a new file beside fn to write instead, so that fn is never left
+		half written, NULL if fn cannot be replaced that way */
+	struct stat st;
+	char *t;
+	int e=lstat(fn,&st);
+
+	if (!e && (!S_ISREG(st.st_mode) || (st.st_nlink > 1)))
+	{
+		/* a rename would break the link */
+		return NULL;
+	}
+
+	t=strjoin("",fn,".aeXXXXXX",NULL);
+
+	if (!t)
+	{
+		return NULL;
+	}
+
+	*fd=mkstemp(t);
+
+	if (*fd < 0)
+	{
+		free(t);
+
+		return NULL;
+	}
+
+	if (e)
+	{
+		mode_t m=umask(0);
+
+		umask(m);
+		st.st_mode=0666&~m;
+	}
+	else if (((st.st_uid!=geteuid()) || (st.st_gid!=getegid()))
+			&& fchown(*fd,st.st_uid,st.st_gid))
+	{
+		/* would not belong to the same owner */
+		close(*fd);
+		unlink(t);
+		free(t);
+
+		return NULL;
+	}
+
+	fchmod(*fd,st.st_mode&07777);
+
+	return t;
+}
+
+static int wr_swap(char *fn,char *t,int r)
+{
+	/* the new file takes the place of fn if it was written */
+	if (r || rename(t,fn))
+	{
+		unlink(t);
+		r=-1;
+	}
+
+	free(t);
+
+	return r;
+}
+#endif
+
+static int write_file(char *fn)
+{
+	int r=-1;
+#ifdef _DEBUG
+	ed_off i=ed_len();
+	ed_off p=0;
+	while (i--)
+	{
+		ed_at(p);
+		p++;
+	}
+#else
+	FILE *f;
+#ifdef SAFE_WRITE
+	char *t;
+	int fd;
+#endif
+
+	if (!fn) return r;
+	if (!fn[0]) return r;
+
+#ifdef SAFE_WRITE
+	/* into a new file that only replaces fn once it is whole */
+	t=wr_temp(fn,&fd);
+
+	if (t)
+	{
+		f=fdopen(fd,"w");
+
+		if (!f)
+		{
+			close(fd);
+
+			return wr_swap(fn,t,-1);
+		}
+	}
+	else
+#endif
+	f=fopen(fn,"w");
+	if (f) 
+	{
+#ifdef JOB_CANCEL
+		ed_off p=0,n=ed_len();
+
+		/* a piece at a time so ESC can stop a Write, but not one
+			that is going straight into the file */
+		r=0;
+
+		while (!r && (p < n))
+		{
+			ed_off l=((n-p) > JOB_COPY) ? JOB_COPY : (n-p);
+
+#ifdef SAFE_WRITE
+			r=(t && jb_look(p,n)) ? -1 : ed_fput(f,p,l);
+#else
+			r=ed_fput(f,p,l);
+#endif
+			p+=l;
+		}
+#else
+		r=ed_fput(f,0,ed_len());
+#endif
+		r|=ferror(f);
+#ifdef SAFE_WRITE
+		if (t)
+		{
+			r|=fflush(f) || fsync(fileno(f));
+		}
+#endif
+		r|=fclose(f);
+	}
+#ifdef SAFE_WRITE
+	if (t)
+	{
+		/* a stopped or failed write leaves fn as it was */
+		r=wr_swap(fn,t,r);
+	}
+#endif
+#endif
+	return r;
+}
+
+
+#ifndef PLOT_CTRL
+
+cuu()
+{
+	tty_row--;
+#ifdef ANSI_SYS
+	co_puts("\033[A");
+#else
+	co_puts("\033A");
+#endif
+}
+
+cud()
+{
+	tty_row++;
+#ifdef ANSI_SYS
+	co_puts("\033[B");
+#else
+	co_puts("\033B");
+#endif
+}
+
+cuf()
+{
+	tty_col++;
+#ifdef ANSI_SYS
+	co_puts("\033[C");
+#else
+	co_puts("\033C");
+#endif
+}
+
+cub()
+{
+	tty_col--;
+#ifdef ANSI_SYS
+	co_puts("\033[D");
+#else
+	co_puts("\033D");
+#endif
+}
+
+home()
+{
+	tty_row=tty_col=0;
+#ifdef ANSI_SYS
+	co_puts("\033[H");
+#else
+	co_puts("\033H");
+#endif
+}
+#endif
+
+
+static void move_right(void)
+{
+	if (ed_pos()!=ed_len()) 
+	{
+		ed_move(1L);
+		if (sel_on) paint_text(-1L);
+	}
+}
+
+static void move_left(void)
+{
+	if (ed_pos()) 
+	{
+		ed_move(-1L);
+		if (sel_on) paint_text(1L);
+	}
+}
+
+static void show_line(void)
+{
+	ed_off p=ed_pos();
+	ed_off i,j;
+	j=0;
+	i=ed_len()-p;
+	while (i--) 
+	{
+		int c=ed_at(p++);
+		if (c==nl) 
+		{
+			i=0;
+		} 
+		else 
+		{
+			j++;
+		}
+	}
+
+	if (j) show_text(ed_pos(),j,status_line);
+	clear_line();
+}
+
+/* upto CR but not including it */
+
+static ed_off line_len(ed_off p)
+{
+	ed_off i=0;
+	ed_off j=ed_len()-p;
+
+	while (j--)
+	{
+		if (ed_at(p++)==nl)
+		{
+			break;
+		}
+
+		i++;
+	}
+
+	return i;
+}
+
+static void delete_char(void)
+{
+	int new_line=0;
+	ed_off pos=ed_pos();
+
+	if (!pos) return;
+
+	row=crsr_row;
+	col=crsr_col;
+
+	if (!col) 
+	{
+		new_line=1;
+	} 
+	else 
+	{
+		ed_off p=ed_pos()-1;
+		ed_off i=line_len(p);
+
+		while (i--) 
+		{
+			int c=ed_at(p++);
+			col=next_col(col,c);
+			if (!col)
+			{
+				new_line=1;
+				i=0;
+			}
+		}
+	}
+
+	/* could add a special case, -
+		if we are deleting character at <0,0>
+		then paint the previous line
+		at the current line */
+
+	ed_del(-1L);
+
+	find_cursor();
+	plot_cursor();
+	row=crsr_row; 
+	col=crsr_col;
+	if (new_line) 
+	{
+		/*	clear_end();*/
+		show_bottom(1);
+		/*	show_status();*/
+	} 
+	else 
+	{
+		show_line();
+		plot_cursor();
+	}
+}
+
+static ed_off sl_phys(ed_off p)
+{
+	/* this returns the start of this line by going back to a previous CR */
+	while (p)
+	{
+		p--;
+
+		while (ed_at(p)==nl)
+		{
+			p++;
+
+			return p;
+		}
+	}
+
+	return p;
+}
+
+static ed_off sl_prev(ed_off p)
+{
+	/* previous actual line start */
+
+	p=sl_phys(p);
+
+	if (p)
+	{
+		p--;
+
+		p=sl_phys(p);
+	}
+
+	return p;
+}
+
+static ed_off next_log(ed_off p)
+{
+	/* find next line either by start of newline, or wrapped the columns */
+	int c=0;
+	ed_off i=ed_len()-p;	/* see how many characters left */
+
+	while (i--)
+	{
+		int ch=ed_at(p++);
+
+		c=next_col(c,ch);
+
+		if (!c)
+		{
+			break;
+		}
+	}
+
+	return p;
+}
+
+static ed_off prev_log(ed_off p)
+{
+	/* previous line as seen on the VDU */
+	ed_off l=sl_prev(p);
+
+	while (l < p)
+	{
+		ed_off m=next_log(l);
+		if (m < p)
+		{
+			l=m;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	return l;
+}
+
+static ed_off sl_this(ed_off p)
+{
+	ed_off q=sl_phys(p);
+	int col=0;
+	ed_off i=ed_len()-q;
+	ed_off m=q;
+
+	while (i--)
+	{
+		if (q >= p)
+		{
+			break;
+		}
+		else
+		{
+			int c=ed_at(q++);
+
+			col=next_col(col,c);
+
+			if (col==0)
+			{
+				m=q;
+			}
+		}
+	}
+
+	return m;
+}
+
+static int col_at(ed_off p)
+{
+	ed_off q=sl_this(p);
+	int col=0;
+	ed_off i=p-q;
+
+	while (i--)
+	{
+		char c=(char)ed_at(q++);
+
+		col=next_col(col,c);
+	}
+
+	return col;
+}
+
+#ifdef NEED_ROW_AT
+static int row_at(ed_off p)
+{
+	int row=0;
+	int col=0;
+	ed_off q=page_start;
+	ed_off i=p-q;
+	if (p < page_start) return -1;
+
+	while (i--)
+	{
+		int c=ed_at(q++);
+
+		col=next_col(col,c);
+
+		if (!col)
+		{
+			row++;
+		}
+
+		if (row > (last_text+1))
+		{
+			i=0;
+		}
+	}
+
+	return row;
+}
+#endif
+
+void repage(void)
+{
+	int r=5;
+	page_start=ed_pos();
+
+	while (r) 
+	{
+		page_start=prev_log(page_start);
+
+		r--;
+
+		if (!page_start) r=0;
+	}
+
+	/*	if (menu_erased) show_status();*/
+	show_top();
+	show_bottom(2);
+	if (menu_erased) show_status();
+	plot_cursor();
+}
+
+#ifdef SCROLL_RGN
+static void scrol_up(void)
+{
+	int i;
+	scrol_rgn(0,last_text);
+	plot_ctrl(last_text,0);
+	co_puts("\033E"); /* next line */
+	scrol_rgn(0,menu_line);
+	plot_ctrl(last_text,0);
+	i=0;
+	while (i < last_text)
+	{
+		chars_per_line[i]=chars_per_line[i+1];
+		i++;
+	}
+	chars_per_line[i]=0;
+}
+
+static void scrol_down(void)
+{
+	int i;
+	scrol_rgn(0,last_text);
+	plot_ctrl(0,0);
+	co_puts("\033M");
+	scrol_rgn(0,menu_line);
+	plot_ctrl(0,0);
+	i=last_text;
+	while (i--)
+	{
+		chars_per_line[i+1]=chars_per_line[i];
+	}
+	chars_per_line[0]=0;
+}
+#endif
+
+static void find_cursor(void)
+{
+	if (page_start > ed_pos()) 
+	{
+#ifdef SCROLL_RGN
+		if (page_start > ed_len())
+		{
+			repage();
+		}
+		else
+		{
+			ed_off prev=prev_log(page_start);
+			if (prev_log(page_start) <= ed_pos())
+			{
+				ed_off i=0;
+				scrol_down();
+				plot(0,0);
+				row=0;
+				col=0;
+				i=page_start-prev;	/* howmany to paint */
+				page_start=prev;
+				show_text(page_start,page_start+i,1);
+			}
+			else
+			{
+				repage();
+			}
+		}
+#else
+		repage();
+#endif
+	}
+
+	while (forever)
+	{
+		ed_off p=page_start;
+		ed_off i=ed_pos()-page_start;
+
+		row=col=0;
+
+		while (i--) 
+		{
+			int c=ed_at(p++);
+
+			col=next_col(col,c);
+
+			if (!col)
+			{
+				row++;
+
+				if (row > status_line)
+				{
+					break;
+				}
+			}
+
+		}
+
+		if (row<status_line) 
+		{
+			crsr_row=row; 
+			crsr_col=col;
+
+			break;
+		} 
+		else 
+		{
+			if (row==status_line) 
+			{
+#ifdef SCROLL_RGN
+				scrol_up();
+#else
+				plot(status_line,0);
+				clear_line();
+				plot(menu_line,0);
+				clear_line();
+#ifdef PLOT_CTRL
+				plot(menu_line,0);								 /* this will get on the last line */
+#endif
+				co(nl);
+#endif
+				crsr_row=row=last_text;
+				crsr_col=col;
+
+				p=page_start;
+				i=ed_pos()-page_start;
+				col=0;
+				while (i--) 
+				{
+					int c=ed_at(p++);
+					page_start++;
+					col=next_col(col,c);
+					if (!col) 
+					{
+						i=0;
+					}
+				}
+
+				{
+					ed_off l=ed_pos();
+					ed_off m=sl_this(l);
+
+					paint_text(m-l);
+				}
+				show_bottom(0);
+				/*		show_status();*/
+
+				break;
+			} 
+			else 
+			{
+				repage();
+			}
+		}
+	}
+}
+
+static void move_up(void)
+{
+	ed_off i;
+	ed_off p;
+	int c2=0;
+
+/*	if (!crsr_row) 
+	{
+		if (!page_start) return;
+		repage();
+		if (!crsr_row) return;
+	}
+*/
+/*	crsr_row--;*/
+
+	p=ed_pos();
+	i=sl_this(p);
+	i=prev_log(i);
+	col=col_at(p);
+
+	while (i < p)
+	{
+		c2=next_col(c2,ed_at(i));
+		if (!c2) 
+		{
+			break;
+		}
+		if (c2 > col)
+		{
+			break;
+		}
+		i++;
+	}
+
+	i=i-p;
+
+	ed_move(i);
+	if (sel_on) paint_text(-i);
+}
+
+static void move_end(void)
+{
+	ed_off p=ed_pos();
+	ed_off i=ed_len()-p;
+	ed_off j=0;
+
+	while (i--) 
+	{
+		if (ed_at(p++)==nl) i=0; 
+		else j++;
+	}
+
+	ed_move(j);
+
+	if (sel_on) paint_text(-j);
+}
+
+static void move_home(void)
+{
+	ed_off j=sl_this(ed_pos());
+	ed_off k=ed_pos()-j;
+
+	ed_move(-k);
+	if (sel_on) paint_text(k);
+}
+
+static void move_down(void)
+{
+	ed_off p=ed_pos();
+	ed_off i=ed_len()-p;
+	ed_off j=0;
+
+	row=crsr_row; 
+	col=crsr_col;
+	crsr_row++;
+
+	while (i--) 
+	{
+		int c=ed_at(p++);
+
+		col=next_col(col,c);
+
+		if (!col)
+		{
+			row++;
+		}
+
+		if (crsr_row < row) 
+		{
+			break;
+		}
+
+		j++;
+
+		if ((crsr_row==row) & (col>=crsr_col)) 
+		{
+			break;
+		}
+	}
+
+	ed_move(j);
+	if (sel_on) paint_text(-j);
+}
+
+static void flip_up(void)
+{
+	ed_off pos=ed_pos();
+	ed_off l=sl_this(pos);
+	int k=total_lines-5;
+	ed_off d;
+
+	while (k--)
+	{
+		if (!l) break;
+
+		l=prev_log(l);
+	}
+
+	d=l-pos;
+	ed_move(d);
+	if (sel_on) paint_text(-d);
+}
+
+static void flip_down(void)
+{
+	ed_off p=ed_pos();
+	int j=total_lines-5;
+	ed_off i=ed_len()-p;
+	int col=0;
+
+	p=sl_this(p);
+
+	while (i--) 
+	{
+		int ch=ed_at(p++);
+		col=next_col(col,ch);
+		if (!col)
+		{
+			j--;
+		}
+		if (j < 0)
+		{
+			i=0;
+		}
+	}
+
+	p-=ed_pos();
+
+	ed_move(p);
+	if (sel_on) paint_text(-p);
+}
+
+#ifdef FRAME_MS
+static int fr_moves(int i)
+{
+	/* the keys cur_key takes */
+	switch (i) 
+	{
+	case ctrl_w:
+	case page_up:
+	case page_down: 
+	case 8:
+	case key_del:
+	case 0x7f: 
+	case key_left: 
+	case key_right: 
+	case key_up: 
+	case key_down: 
+	case key_start:
+	case key_end:
+		return 1;
+	}
+
+	return 0;
+}
+
+static long fr_age(void)
+{
+	struct timeval t;
+
+	gettimeofday(&t,NULL);
+
+	return (long)(t.tv_sec-fr.t0.tv_sec)*1000+(long)(t.tv_usec-fr.t0.tv_usec)/1000;
+}
+
+static void fr_show(void)
+{
+	/* the terminal has missed some output, draw it all again */
+	if (fr.held)
+	{
+		fr.held=0;
+		cls();
+		show_top();
+		show_bottom(2);
+		show_status();
+		plot_cursor();
+		fflush(stdout);
+	}
+}
+#endif
+
+static int cur_key(int i)
+{
+#ifdef FRAME_MS
+	if (!fr.held && fr_moves(i) && co_ready(0))
+	{
+		/* held down, only draw once the keys stop or the frame is due */
+		fr.held=1;
+		gettimeofday(&fr.t0,NULL);
+	}
+#endif
+
+	switch (i) 
+	{
+	case ctrl_w:
+		ed_tzap();
+		cls(); 
+		menu_erased=1;
+		repage(); 
+		break;
+	case page_up:
+		if (ed_pos())
+		{
+			flip_up(); 
+		}
+		break;
+	case page_down: 
+		flip_down(); 
+		break;
+	case 8:
+	case key_del:
+	case 0x7f: 
+		delete_char(); 
+		break;
+	case key_left: 
+		move_left(); 
+		break;
+	case key_right: 
+		move_right(); 
+		break;
+	case key_up: 
+		move_up(); 
+		break;
+	case key_down: 
+		move_down(); 
+		break;
+	case key_start:
+		move_home();
+		break;
+	case key_end:
+		move_end();
+		break;
+	default: 
+		return 0;
+	}
+	find_cursor();
+	plot_cursor();
+#ifdef FRAME_MS
+	if (fr.held && ((fr_age() >= FRAME_MS) || !co_ready(0)))
+	{
+		fr_show();
+	}
+#endif
+	fflush(stdout);
+	return 1;   
+}
+
+#ifdef PASTE_WAIT
+static void do_paste(void)
+{
+	/* pasted text goes in as it came, a piece at a time rather than
+		a key at a time, and is drawn once */
+	char buf[4096];
+	ed_off p=ed_pos();
+	long l;
+
+	while ((l=co_paste(buf,sizeof(buf))) > 0)
+	{
+		if (!view_only)
+		{
+			ed_insn(buf,l);
+		}
+	}
+
+	if (ed_pos()!=p)
+	{
+		find_cursor();
+		paint_text(p-ed_pos());
+		show_bottom(1);
+		if (menu_erased) show_status();
+		plot_cursor();
+		fflush(stdout);
+	}
+}
+#endif
+
+static void insert_text(void)
+{
+	int c;
+	if (view_only) return;
+	menu_erased=1;
+	show_status();
+	plot_cursor();
+	fflush(stdout);
+	while (escape!=(c=getkey())) 
+	{
+		if (c==key_ins) break;
+		if (c==ctrl_z				 /*|(c==key_home)*/ ) break;
+		if (c==key_find) break;
+		if (c==key_sel) break;
+
+#ifdef SQUASH_CR
+		if (c==13) c=-1;
+#endif
+
+		if (c==-1) 
+		{
+#ifdef PASTE_WAIT
+			if (pasting)
+			{
+				do_paste();
+			}
+#endif
+			continue;
+		}
+
+		if (!cur_key(c)) 
+		{
+			ed_off p=ed_pos(),i;
+			int new_line=0;
+
+			if (c==13) c=nl;
+
+
+			if (mode=='i') 
+			{
+				ed_ins(c);
+				ed_move(-1L);
+			} 
+			else 
+			{
+				if (p != ed_len())
+				{
+					if (nl != ed_at(p))
+					{
+						ed_del(1L);
+					}
+				}
+
+				ed_ins(c);
+				ed_move(-1L);
+			}
+
+			if (c==nl) new_line=1;
+
+			row=crsr_row; 
+			col=crsr_col;
+			i=ed_len()-p;
+
+			while (i--) 
+			{
+				c=ed_at(p++);
+
+				if (c==nl) break;
+
+				col=next_col(col,c);
+
+				if (!col)
+				{
+					i=0;
+					new_line=1;
+				}
+			}
+
+			row=crsr_row; 
+			col=crsr_col;
+			plot_cursor();
+			if (new_line) 
+			{
+				/*	clear_end();*/
+				show_bottom(2);
+				/*	show_status();*/
+			} 
+			else 
+			{
+				ed_off j=0;
+				p=ed_pos();
+				i=ed_len()-p;
+				while (i--) 
+				{
+					if (ed_at(p++)==nl)
+					{
+						i=0;
+					}
+					else
+					{
+						j++;
+					}
+				}
+				show_text(ed_pos(),j,1+crsr_row);
+				clear_line();
+			}
+			ed_move(1L);
+			find_cursor();
+			plot_cursor();
+			fflush(stdout);
+		}     	
+	}
+}
+
+static int ed_fput(FILE *f,ed_off p,ed_off n)
+{
+	/* write n document bytes from p a run at a time, runs in the
+		temp file are copied by the kernel where it can,
+		returns -1 if they did not all go */
+#ifdef SPAN_COPY
+	int fd=fileno(f);
+	int direct=!fflush(f);
+	int moved=0;
+#endif
+
+	while (n > 0)
+	{
+		ed_off st;
+		long l;
+		char *b;
+
+#ifdef SPAN_COPY
+		if (direct)
+		{
+			ed_off fo;
+
+			l=(n > SPAN_MAX) ? SPAN_MAX : (long)n;
+			b=ed_where(p,&l,&fo);
+
+			if (!b)
+			{
+				loff_t o=fo;
+				ssize_t i=copy_file_range(ed_fd(),&o,fd,NULL,(size_t)l,0);
+
+				if (i > 0)
+				{
+					p+=i;
+					n-=i;
+					moved=1;
+					continue;
+				}
+
+				/* not between these files, so the old way */
+				b=ed_span(p,&st,&l);
+				b+=p-st;
+				l-=(long)(p-st);
+			}
+
+			if (l > n) l=(long)n;
+
+			while (l > 0)
+			{
+				ssize_t i=write(fd,b,(size_t)l);
+
+				if (i <= 0)
+				{
+					direct=0;
+					break;
+				}
+
+				b+=i;
+				l-=(long)i;
+				p+=i;
+				n-=i;
+				moved=1;
+			}
+
+			if (!direct)
+			{
+				break;
+			}
+
+			continue;
+		}
+#endif
+
+		b=ed_span(p,&st,&l);
+		b+=p-st;
+		l-=(long)(p-st);
+
+		if (l > n) l=(long)n;
+
+		if (fwrite(b,1,l,f)!=(size_t)l)
+		{
+			break;
+		}
+
+		p+=l;
+		n-=l;
+	}
+
+#ifdef SPAN_COPY
+	if (moved)
+	{
+		/* stdio is behind the descriptor */
+		ed_fseek(f,(ed_off)lseek(fd,0,SEEK_CUR),SEEK_SET);
+	}
+#endif
+
+	return n ? -1 : 0;
+}
+
+static void ed_fget(FILE *f,ed_off size)
+{
+	/* insert size bytes of f at the cursor, or if size is 0 the
+		rest of it */
+	char buf[4096];
+	long l;
+
+#ifdef SPAN_COPY
+	if (size > 0)
+	{
+		ed_off at=ed_pos();
+		ed_off n=0;
+		loff_t in=ed_ftell(f);
+
+		/* straight into the gap in the temp file */
+		if (cur_file.low_size)
+		{
+			ed_dump(-cur_file.low_size);
+		}
+
+		if ((in >= 0) && !ed_reserve(size))
+		{
+#ifdef FIND_INDEX
+			mx_cut(at,0);
+#endif
+#ifdef SAVE_THREAD
+			sv_hold(cur_file.t_lol,size);
+#endif
+			while (n < size)
+			{
+				loff_t o=cur_file.t_lol;
+				ssize_t i=copy_file_range(fileno(f),&in,ed_fd(),&o,(size_t)(((size-n) > SPAN_MAX) ? SPAN_MAX : (size-n)),0);
+
+				if (i <= 0)
+				{
+					break;
+				}
+
+				cur_file.t_lol+=i;
+				n+=i;
+			}
+
+			if (n)
+			{
+				ed_tzap();
+#ifdef HAVE_MMAP
+				cur_file.t_mstale=1;
+#endif
+			}
+#ifdef FIND_INDEX
+			mx_add(at,n);
+#endif
+#ifdef UNDO_LOG
+			ud_ins(at,n);
+#endif
+#ifdef JOURNAL
+			jn_ins(at,n);
+#endif
+#ifdef DIRTY_SAVE
+			dx_ins(at,n);
+#endif
+			ed_fseek(f,in,SEEK_SET);
+		}
+
+		if (n==size)
+		{
+			return;
+		}
+
+		size-=n;
+	}
+#endif
+
+	while (forever)
+	{
+		l=sizeof(buf);
+
+		if ((size > 0) && (size < l))
+		{
+			l=(long)size;
+		}
+
+		l=(long)fread(buf,1,l,f);
+
+		if (l <= 0)
+		{
+			break;
+		}
+
+		ed_insn(buf,l);
+
+		if (size > 0)
+		{
+			size-=l;
+
+			if (!size)
+			{
+				break;
+			}
+		}
+	}
+}
+
+#ifdef UNDO_LOG
+/* every edit is logged as the text now at a place and the length of
+	what it replaced, the replaced text is appended to a temp file,
+	copied there from the spill file by the kernel where it can be.
+	undo and redo both swap the two, so only what is taken out of the
+	document is ever written */
+struct ud_rec
+{
+	ed_off at;	/* where the text is */
+	ed_off cur;	/* its length in the document */
+	ed_off alt;	/* length of what it replaced */
+	ed_off off;	/* where that is in the log file */
+	long grp;	/* the command it was part of */
+};
+
+static struct
+{
+	FILE *fp;		/* replaced text */
+	ed_off end;		/* length of fp */
+	struct ud_rec *r;
+	long n;			/* records */
+	long top;		/* records in effect, the rest can be redone */
+	long size;
+	long grp;		/* bumped for every command */
+	int busy;		/* swapping, so not logging */
+} ud;
+
+static void ud_free(void)
+{
+	if (ud.fp)
+	{
+		fclose(ud.fp);
+	}
+
+	if (ud.r)
+	{
+		free(ud.r);
+	}
+
+	ud.fp=NULL;
+	ud.end=0;
+	ud.r=NULL;
+	ud.n=0;
+	ud.top=0;
+	ud.size=0;
+}
+
+static void ud_drop(void)
+{
+	/* an edit after undo, the redo records go */
+	long i;
+	ed_off e=0;
+
+	ud.n=ud.top;
+
+	for (i=0; i < ud.n; i++)
+	{
+		if (ud.r[i].alt && (e < (ud.r[i].off+ud.r[i].alt)))
+		{
+			e=ud.r[i].off+ud.r[i].alt;
+		}
+	}
+
+#ifdef HAVE_FTRUNCATE
+	if (ud.fp && (e < ud.end) && !fflush(ud.fp) && !ftruncate(fileno(ud.fp),e))
+	{
+		ud.end=e;
+	}
+#endif
+}
+
+static struct ud_rec *ud_last(void)
+{
+	/* the record this command can add to */
+	if (ud.top && (ud.top==ud.n) && (ud.r[ud.top-1].grp==ud.grp))
+	{
+		return ud.r+ud.top-1;
+	}
+
+	return NULL;
+}
+
+static ed_off ud_save(ed_off p,ed_off n)
+{
+	/* append document text to the log file, returns where */
+	ed_off o=ud.end;
+
+	if (!ud.fp)
+	{
+		ud.fp=tmpfile();
+
+		if (!ud.fp)
+		{
+			return -1;
+		}
+	}
+
+	if (ed_fseek(ud.fp,o,SEEK_SET))
+	{
+		return -1;
+	}
+
+	ed_fput(ud.fp,p,n);
+
+	if (fflush(ud.fp) || (ed_ftell(ud.fp)!=(o+n)))
+	{
+		return -1;
+	}
+
+	ud.end=o+n;
+
+	return o;
+}
+
+static void ud_new(ed_off at,ed_off cur,ed_off alt,ed_off off)
+{
+	struct ud_rec *r;
+
+	if (ud.n==ud.size)
+	{
+		long m=ud.size ? 2*ud.size : 1024;
+
+		r=realloc(ud.r,m*sizeof(r[0]));
+
+		if (!r)
+		{
+			/* cannot go back past here */
+			ud_free();
+
+			return;
+		}
+
+		ud.r=r;
+		ud.size=m;
+	}
+
+	r=ud.r+ud.n++;
+	r->at=at;
+	r->cur=cur;
+	r->alt=alt;
+	r->off=off;
+	r->grp=ud.grp;
+	ud.top=ud.n;
+}
+
+static void ud_del(ed_off p,ed_off n)
+{
+	/* n bytes at p are about to go */
+	struct ud_rec *r;
+	ed_off o;
+
+	if (ud.busy)
+	{
+		return;
+	}
+
+	if (ud.top < ud.n)
+	{
+		ud_drop();
+	}
+
+	r=ud_last();
+
+	if (r && (p >= r->at) && ((p+n) <= (r->at+r->cur)))
+	{
+		/* taking back what this command put in */
+		r->cur-=n;
+
+		return;
+	}
+
+	o=ud_save(p,n);
+
+	if (o < 0)
+	{
+		ud_free();
+
+		return;
+	}
+
+	if (r && (p==(r->at+r->cur)) && ((r->off+r->alt)==o))
+	{
+		/* deleting on forward */
+		r->alt+=n;
+
+		return;
+	}
+
+	ud_new(p,0,n,o);
+}
+
+static void ud_ins(ed_off p,ed_off n)
+{
+	/* n bytes have gone in at p */
+	struct ud_rec *r;
+
+	if (ud.busy || !n)
+	{
+		return;
+	}
+
+	if (ud.top < ud.n)
+	{
+		ud_drop();
+	}
+
+	r=ud_last();
+
+	if (r && (p >= r->at) && (p <= (r->at+r->cur)))
+	{
+		r->cur+=n;
+
+		return;
+	}
+
+	ud_new(p,n,0,0);
+}
+
+static int ud_swap(struct ud_rec *r)
+{
+	/* put back what the record replaced and keep what was there */
+	ed_off o=0;
+	ed_off n;
+
+	if (r->cur)
+	{
+		o=ud_save(r->at,r->cur);
+
+		if (o < 0)
+		{
+			return -1;
+		}
+	}
+
+	ed_move(r->at-ed_pos());
+	ed_del(r->cur);
+
+	if (r->alt)
+	{
+		if (ed_fseek(ud.fp,r->off,SEEK_SET))
+		{
+			return -1;
+		}
+
+		ed_fget(ud.fp,r->alt);
+	}
+
+	n=r->cur;
+	r->cur=r->alt;
+	r->alt=n;
+	r->off=o;
+
+	return (ed_pos()==(r->at+r->cur)) ? 0 : -1;
+}
+#endif /* UNDO_LOG */
+
+#ifdef JOURNAL
+/* each edit since the file was written is appended to file.aej, an
+	insert with its text, so after a crash -r can put the edits back on
+	to the file in time that goes with them rather than with the file */
+struct jn_head
+{
+	char magic[8];
+	ed_off size;	/* of the file the edits go on to */
+	ed_off mtime;
+};
+
+static struct
+{
+	FILE *fp;
+	char *name;
+	ed_off at,n;	/* insert not written out yet */
+	int dirty;		/* written since the last fsync */
+	int busy;		/* replaying */
+	int off;		/* someone else has the journal */
+	time_t synced;
+} jn;
+
+static char *jn_path(char *fn)
+{
+	return strjoin("",fn,".aej",NULL);
+}
+
+static void jn_head(char *fn,struct jn_head *h)
+{
+	struct stat s;
+
+	memset(h,0,sizeof(*h));
+	memcpy(h->magic,JOURNAL_MAGIC,sizeof(JOURNAL_MAGIC));
+
+	if (!stat(fn,&s))
+	{
+		h->size=(ed_off)s.st_size;
+		h->mtime=(ed_off)s.st_mtime;
+	}
+}
+
+static int jn_check(char *fn)
+{
+	/* 0 for no journal, 1 if it goes with the file, -1 if not */
+	struct jn_head h,k;
+	char *p=jn_path(fn);
+	FILE *fp=fopen(p,"r");
+	int i=0;
+
+	if (fp)
+	{
+		jn_head(fn,&k);
+
+		i=((fread(&h,sizeof(h),1,fp)==1) && !memcmp(&h,&k,sizeof(h))) ? 1 : -1;
+
+		fclose(fp);
+	}
+
+	free(p);
+
+	return i;
+}
+
+static void jn_end(void)
+{
+	/* the file has been written or the edits abandoned */
+	if (jn.fp)
+	{
+		fclose(jn.fp);
+		jn.fp=NULL;
+		unlink(jn.name);
+	}
+
+	if (jn.name)
+	{
+		free(jn.name);
+		jn.name=NULL;
+	}
+
+	jn.n=0;
+	jn.dirty=0;
+	jn.off=0;
+}
+
+static void jn_lose(void)
+{
+	/* a journal with a gap in it is worse than none */
+	jn_end();
+	jn.off=1;
+}
+
+static int jn_open(void)
+{
+	struct jn_head h;
+	int fd;
+
+	if (jn.fp)
+	{
+		return 0;
+	}
+
+	if (jn.off || jn.busy || view_only || !filename)
+	{
+		return -1;
+	}
+
+	jn.name=jn_path(filename);
+
+	/* never over one left by a crash or by another editor */
+	fd=open(jn.name,O_RDWR|O_CREAT|O_EXCL,0600);
+
+	if (fd < 0)
+	{
+		free(jn.name);
+		jn.name=NULL;
+		jn.off=1;
+
+		return -1;
+	}
+
+	jn.fp=fdopen(fd,"w");
+
+	if (!jn.fp)
+	{
+		close(fd);
+		unlink(jn.name);
+		jn_lose();
+
+		return -1;
+	}
+
+	jn_head(filename,&h);
+
+	if (fwrite(&h,sizeof(h),1,jn.fp)!=1)
+	{
+		jn_lose();
+
+		return -1;
+	}
+
+	jn.dirty=1;
+	jn.synced=time(NULL);
+
+	return 0;
+}
+
+static void jn_rec(int op,ed_off at,ed_off n)
+{
+	ed_off r[3];
+
+	r[0]=op;
+	r[1]=at;
+	r[2]=n;
+
+	if (fwrite(r,sizeof(r),1,jn.fp)!=1)
+	{
+		jn_lose();
+	}
+	else
+	{
+		jn.dirty=1;
+	}
+}
+
+static void jn_put(ed_off moved)
+{
+	/* write out the insert, its text is still in the document moved
+		along by however much has gone in before it since */
+	if (jn.n)
+	{
+		ed_off o;
+
+		jn_rec('i',jn.at,jn.n);
+
+		if (!jn.fp)
+		{
+			return;
+		}
+
+		o=ed_ftell(jn.fp);
+
+		ed_fput(jn.fp,jn.at+moved,jn.n);
+
+		if (ed_ftell(jn.fp)!=(o+jn.n))
+		{
+			jn_lose();
+
+			return;
+		}
+
+		jn.n=0;
+	}
+}
+
+static void jn_del(ed_off p,ed_off n)
+{
+	/* n bytes at p are about to go */
+	if (jn.n && (p >= jn.at) && ((p+n) <= (jn.at+jn.n)))
+	{
+		jn.n-=n;
+
+		return;
+	}
+
+	if (jn_open())
+	{
+		return;
+	}
+
+	jn_put(0);
+
+	if (jn.fp)
+	{
+		jn_rec('d',p,n);
+	}
+}
+
+static void jn_ins(ed_off p,ed_off n)
+{
+	/* n bytes have gone in at p, they are written out later so that
+		typing makes one record */
+	if (!n || jn_open())
+	{
+		return;
+	}
+
+	if (jn.n && (p >= jn.at) && (p <= (jn.at+jn.n)))
+	{
+		jn.n+=n;
+
+		return;
+	}
+
+	/* the text waiting to be written may have just moved up */
+	jn_put((p < jn.at) ? n : 0);
+
+	if (jn.fp)
+	{
+		jn.at=p;
+		jn.n=n;
+	}
+}
+
+static void jn_wait(void)
+{
+	/* about to wait for a key, the journal goes to the disk once typing
+		stops for a moment, or anyway every few seconds */
+	if (!jn.fp || !(jn.dirty || jn.n))
+	{
+		return;
+	}
+
+#ifdef JOB_CANCEL
+	if (key_iahead < key_nahead)
+	{
+		return;
+	}
+#endif
+
+	if (fflush(jn.fp))
+	{
+		jn_lose();
+
+		return;
+	}
+
+	if ((time(NULL)-jn.synced) < JOURNAL_SYNC)
+	{
+		if ((ev_wait(JOURNAL_SYNC*1000,-1) > 0) || winched)
+		{
+			return;
+		}
+	}
+
+	jn_put(0);
+
+	if (jn.fp && (fflush(jn.fp) || fsync(fileno(jn.fp))))
+	{
+		jn_lose();
+	}
+
+	jn.dirty=0;
+	jn.synced=time(NULL);
+}
+
+static long jn_replay(void)
+{
+	/* put the edits in the journal back on to the file just loaded,
+		then carry on adding to it */
+	ed_off r[3];
+	ed_off e,o;
+	struct stat s;
+	long n=0;
+	FILE *fp;
+
+	jn.name=jn_path(filename);
+	fp=fopen(jn.name,"r+");
+
+	if (!fp || fstat(fileno(fp),&s) || ed_fseek(fp,(ed_off)sizeof(struct jn_head),SEEK_SET))
+	{
+		if (fp) fclose(fp);
+		jn_lose();
+
+		return -1;
+	}
+
+	e=(ed_off)s.st_size;
+	jn.busy=1;
+
+	while (forever)
+	{
+		o=ed_ftell(fp);
+
+		if ((fread(r,sizeof(r),1,fp)!=1) || (r[1] < 0) || (r[2] <= 0) || (r[1] > ed_len()))
+		{
+			break;
+		}
+
+		if ((r[0]=='i') && (r[2] <= (e-o-(ed_off)sizeof(r))))
+		{
+			ed_move(r[1]-ed_pos());
+			ed_fget(fp,r[2]);
+		}
+		else if ((r[0]=='d') && ((r[1]+r[2]) <= ed_len()))
+		{
+			ed_move(r[1]-ed_pos());
+			ed_del(r[2]);
+		}
+		else
+		{
+			break;
+		}
+
+		if (ed_ftell(fp)!=(o+(ed_off)sizeof(r)+((r[0]=='i') ? r[2] : 0)))
+		{
+			/* not sure what went in, so leave the journal be */
+			fclose(fp);
+			jn.busy=0;
+			jn_lose();
+
+			return -1;
+		}
+
+		n++;
+	}
+
+	jn.busy=0;
+
+	/* anything after the last whole edit was cut short by the crash */
+	if (ed_fseek(fp,o,SEEK_SET) || fflush(fp) || ftruncate(fileno(fp),o))
+	{
+		fclose(fp);
+		jn_lose();
+
+		return n;
+	}
+
+	jn.fp=fp;
+	jn.dirty=1;
+	jn.synced=time(NULL);
+
+	return n;
+}
+#endif /* JOURNAL */
+
+#ifdef DIRTY_SAVE
+/* the document as runs of the file it came from and of new text, so
+	Update can write back only what changed or moved, in place, after
+	first putting it in file.aes so a crash part way can be finished */
+struct dx_seg
+{
+	ed_off o;	/* where the run is in the file, -1 if new */
+	ed_off n;
+};
+
+struct dx_head
+{
+	char magic[8];
+	ed_off size;	/* of the file when it is done */
+};
+
+static struct
+{
+	struct dx_seg *s;
+	long n,size;
+	int ok;			/* the runs describe the document */
+	struct stat st;	/* the file as loaded or last written */
+} dx;
+
+static char *dx_path(char *fn)
+{
+	return strjoin("",fn,".aes",NULL);
+}
+
+static int dx_same(struct stat *a,struct stat *b)
+{
+	return (a->st_dev==b->st_dev) && (a->st_ino==b->st_ino)
+		&& (a->st_size==b->st_size) && (a->st_mtime==b->st_mtime)
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+		&& (a->st_mtim.tv_nsec==b->st_mtim.tv_nsec)
+#endif
+		;
+}
+
+static void dx_lose(void)
+{
+	dx.n=0;
+	dx.ok=0;
+}
+
+static void dx_base(void)
+{
+	/* one run of the file for the whole document */
+	dx_lose();
+
+	if (!dx.s)
+	{
+		dx.s=malloc(16*sizeof(dx.s[0]));
+
+		if (!dx.s)
+		{
+			return;
+		}
+
+		dx.size=16;
+	}
+
+	if (ed_len())
+	{
+		dx.s[0].o=0;
+		dx.s[0].n=ed_len();
+		dx.n=1;
+	}
+
+	dx.ok=1;
+}
+
+static void dx_init(char *fn)
+{
+	/* the document is the file again */
+	dx_lose();
+
+	if (fn && !stat(fn,&dx.st) && S_ISREG(dx.st.st_mode) && ((ed_off)dx.st.st_size==ed_len()))
+	{
+		dx_base();
+	}
+}
+
+static int dx_room(long i)
+{
+	/* open a slot at i */
+	if (dx.n==dx.size)
+	{
+		long m=2*dx.size;
+		struct dx_seg *s;
+
+		if (m > DIRTY_SEGS)
+		{
+			return -1;
+		}
+
+		s=realloc(dx.s,m*sizeof(s[0]));
+
+		if (!s)
+		{
+			return -1;
+		}
+
+		dx.s=s;
+		dx.size=m;
+	}
+
+	memmove(dx.s+i+1,dx.s+i,(dx.n-i)*sizeof(dx.s[0]));
+	dx.n++;
+
+	return 0;
+}
+
+static long dx_split(ed_off p)
+{
+	/* the run that starts at p, splitting one if need be */
+	ed_off d=0;
+	long i;
+
+	for (i=0; i < dx.n; i++)
+	{
+		if (p==d)
+		{
+			return i;
+		}
+
+		if (p < (d+dx.s[i].n))
+		{
+			break;
+		}
+
+		d+=dx.s[i].n;
+	}
+
+	if (i==dx.n)
+	{
+		return i;
+	}
+
+	if (dx_room(i))
+	{
+		return -1;
+	}
+
+	dx.s[i].n=p-d;
+	dx.s[i+1].n-=p-d;
+
+	if (dx.s[i+1].o >= 0)
+	{
+		dx.s[i+1].o+=p-d;
+	}
+
+	return i+1;
+}
+
+static void dx_ins(ed_off p,ed_off n)
+{
+	long i;
+
+	if (!dx.ok || !n)
+	{
+		return;
+	}
+
+	i=dx_split(p);
+
+	if (i < 0)
+	{
+		dx_lose();
+
+		return;
+	}
+
+	if (i && (dx.s[i-1].o < 0))
+	{
+		dx.s[i-1].n+=n;
+
+		return;
+	}
+
+	if (dx_room(i))
+	{
+		dx_lose();
+
+		return;
+	}
+
+	dx.s[i].o=-1;
+	dx.s[i].n=n;
+}
+
+static void dx_del(ed_off p,ed_off n)
+{
+	long i,j;
+
+	if (!dx.ok || !n)
+	{
+		return;
+	}
+
+	i=dx_split(p);
+	j=(i < 0) ? -1 : dx_split(p+n);
+
+	if (j < 0)
+	{
+		dx_lose();
+
+		return;
+	}
+
+	memmove(dx.s+i,dx.s+j,(dx.n-j)*sizeof(dx.s[0]));
+	dx.n-=j-i;
+
+	/* join what now meets */
+	if (i && (i < dx.n)
+		&& (((dx.s[i-1].o < 0) && (dx.s[i].o < 0))
+			|| ((dx.s[i-1].o >= 0) && ((dx.s[i-1].o+dx.s[i-1].n)==dx.s[i].o))))
+	{
+		dx.s[i-1].n+=dx.s[i].n;
+		dx.n--;
+		memmove(dx.s+i,dx.s+i+1,(dx.n-i)*sizeof(dx.s[0]));
+	}
+}
+
+static int dx_put(FILE *f,int redo)
+{
+	/* the runs not already where the file has them, either as
+		records in the redo file or in place */
+	ed_off d=0;
+	long i;
+
+	for (i=0; i < dx.n; i++)
+	{
+		ed_off n=dx.s[i].n;
+
+		if (dx.s[i].o!=d)
+		{
+			if (redo)
+			{
+				ed_off r[2];
+
+				r[0]=d;
+				r[1]=n;
+
+				if (fwrite(r,sizeof(r),1,f)!=1)
+				{
+					return -1;
+				}
+			}
+			else if (ed_fseek(f,d,SEEK_SET))
+			{
+				return -1;
+			}
+
+			if (ed_fput(f,d,n))
+			{
+				return -1;
+			}
+		}
+
+		d+=n;
+	}
+
+	return 0;
+}
+
+static int dx_save(void)
+{
+	/* 0 if what changed went back into the file in place, 1 if it
+		has to be written whole, -1 if it failed part way, in which
+		case file.aes is left to finish it next time */
+	struct dx_head h;
+	struct stat st;
+	ed_off r[2];
+	ed_off b=0,d=0;
+	char *name;
+	FILE *f=NULL;
+	long i;
+	int fd;
+
+	if (!dx.ok || !filename || stat(filename,&st) || !dx_same(&st,&dx.st))
+	{
+		return 1;
+	}
+
+	for (i=0; i < dx.n; i++)
+	{
+		if (dx.s[i].o!=d)
+		{
+			b+=dx.s[i].n;
+		}
+
+		d+=dx.s[i].n;
+	}
+
+	if ((2*b) > ed_len())
+	{
+		/* most of it has moved */
+		return 1;
+	}
+
+	name=dx_path(filename);
+	fd=open(name,O_WRONLY|O_CREAT|O_TRUNC,0600);
+
+	if (fd >= 0)
+	{
+		f=fdopen(fd,"w");
+
+		if (!f)
+		{
+			close(fd);
+		}
+	}
+
+	memset(&h,0,sizeof(h));
+	memcpy(h.magic,DIRTY_MAGIC,sizeof(DIRTY_MAGIC));
+	h.size=ed_len();
+	r[0]=-1;
+	r[1]=ed_len();
+
+	if (!f || (fwrite(&h,sizeof(h),1,f)!=1) || dx_put(f,1)
+		|| (fwrite(r,sizeof(r),1,f)!=1) || fflush(f) || fsync(fileno(f)))
+	{
+		if (f) fclose(f);
+		unlink(name);
+		free(name);
+
+		return 1;
+	}
+
+	fclose(f);
+
+	/* now it is safe to overwrite */
+	f=fopen(filename,"r+");
+
+	if (!f)
+	{
+		unlink(name);
+		free(name);
+
+		return 1;
+	}
+
+	i=dx_put(f,0) || fflush(f) || ftruncate(fileno(f),ed_len()) || fsync(fileno(f));
+
+	if (fclose(f) || i)
+	{
+		free(name);
+
+		return -1;
+	}
+
+	unlink(name);
+	free(name);
+
+	return 0;
+}
+
+static void dx_redo(char *fn)
+{
+	/* finish an in place save that was cut short, or forget one
+		that never got as far as touching the file */
+	struct dx_head h;
+	struct stat st;
+	ed_off r[2];
+	char *name=dx_path(fn);
+	FILE *f=fopen(name,"r");
+	int whole=0,done=0;
+
+	if (f)
+	{
+		if (!fstat(fileno(f),&st) && (fread(&h,sizeof(h),1,f)==1)
+			&& !memcmp(h.magic,DIRTY_MAGIC,sizeof(DIRTY_MAGIC))
+			&& !ed_fseek(f,(ed_off)st.st_size-(ed_off)sizeof(r),SEEK_SET)
+			&& (fread(r,sizeof(r),1,f)==1) && (r[0]==-1) && (r[1]==h.size)
+			&& !ed_fseek(f,(ed_off)sizeof(h),SEEK_SET))
+		{
+			FILE *t=fopen(fn,"r+");
+
+			whole=1;
+
+			while (t && (fread(r,sizeof(r),1,f)==1) && (r[0] >= 0) && !ed_fseek(t,r[0],SEEK_SET))
+			{
+				while (r[1] > 0)
+				{
+					char buf[4096];
+					size_t l=(r[1] > (ed_off)sizeof(buf)) ? sizeof(buf) : (size_t)r[1];
+
+					if ((fread(buf,1,l,f)!=l) || (fwrite(buf,1,l,t)!=l))
+					{
+						break;
+					}
+
+					r[1]-=l;
+				}
+
+				if (r[1])
+				{
+					break;
+				}
+			}
+
+			if (t)
+			{
+				done=(r[0]==-1) && !fflush(t) && !ftruncate(fileno(t),h.size) && !fsync(fileno(t));
+				done&=!fclose(t);
+			}
+		}
+
+		fclose(f);
+
+		if (done || !whole)
+		{
+			unlink(name);
+		}
+
+#ifdef JOURNAL
+		if (done)
+		{
+			/* the edits in it are in the file now */
+			char *j=jn_path(fn);
+
+			unlink(j);
+			free(j);
+		}
+#endif
+	}
+
+	free(name);
+}
+#endif /* DIRTY_SAVE */
+
+#ifdef SAVE_THREAD
+/* Update writes the file whole on a thread from a copy of the in memory
+	part and the offsets of the temp file parts, the engine waits before
+	it writes over any of the temp file the thread has still to read,
+	the new file is renamed over the old one only once it is whole */
+static struct
+{
+	pthread_mutex_t lock;
+	pthread_t t;
+	int busy;		/* a thread has been started */
+	int done;		/* and has finished with r */
+	int r;
+	int fd;			/* the temp file */
+	FILE *f;
+	char *name;		/* being written, to become filename */
+	ed_off jat;		/* where the journal was when it was copied */
+	char *mem;		/* low then high part of the buffer */
+	long low,high;
+	ed_off lol,hip,hil;
+	ed_off len,out;	/* written so far */
+} sv={PTHREAD_MUTEX_INITIALIZER};
+
+static void *sv_work(void *arg)
+{
+	sigset_t s;
+	char *buf=sv.mem+sv.low+sv.high;
+	int r=0,i;
+
+	sigfillset(&s);
+	pthread_sigmask(SIG_BLOCK,&s,NULL);
+
+	for (i=0; (i < 3) && !r; i++)
+	{
+		ed_off o=(i==2) ? sv.hip : 0;
+		ed_off n=(i==0) ? sv.lol : ((i==1) ? (ed_off)(sv.low+sv.high) : sv.hil);
+
+		while (n && !r)
+		{
+			long m=(n > SAVE_CHUNK) ? SAVE_CHUNK : (long)n;
+			char *p=sv.mem+o;
+
+			if (i!=1)
+			{
+				p=buf;
+
+				if (pread(sv.fd,buf,m,o)!=m)
+				{
+					r=-1;
+				}
+			}
+
+			if (!r && (fwrite(p,1,m,sv.f)!=(size_t)m))
+			{
+				r=-1;
+			}
+
+			o+=m;
+			n-=m;
+
+			pthread_mutex_lock(&sv.lock);
+			sv.out+=m;
+			pthread_mutex_unlock(&sv.lock);
+		}
+	}
+
+	r|=ferror(sv.f);
+	r|=fflush(sv.f) || fsync(fileno(sv.f));
+	r|=fclose(sv.f);
+
+	pthread_mutex_lock(&sv.lock);
+	sv.r=r;
+	sv.done=1;
+	pthread_mutex_unlock(&sv.lock);
+
+	ev_wake();
+
+	return arg;
+}
+
+static int sv_start(void)
+{
+	/* 1 if the save is under way */
+	char *p=cur_file.buffer+cur_file.buf_size-cur_file.high_size;
+	int fd;
+
+	if (!filename || !filename[0])
+	{
+		return 0;
+	}
+
+	sv.mem=malloc(cur_file.low_size+cur_file.high_size+SAVE_CHUNK);
+
+	if (!sv.mem)
+	{
+		return 0;
+	}
+
+	sv.name=wr_temp(filename,&fd);
+	sv.f=sv.name ? fdopen(fd,"w") : NULL;
+
+	if (!sv.f)
+	{
+		if (sv.name)
+		{
+			close(fd);
+			wr_swap(filename,sv.name,-1);
+		}
+
+		free(sv.mem);
+
+		return 0;
+	}
+
+	memcpy(sv.mem,cur_file.buffer,cur_file.low_size);
+	memcpy(sv.mem+cur_file.low_size,p,cur_file.high_size);
+	sv.low=cur_file.low_size;
+	sv.high=cur_file.high_size;
+	sv.lol=cur_file.t_lol;
+	sv.hip=cur_file.t_hip;
+	sv.hil=cur_file.t_hil;
+	sv.len=ed_len();
+	sv.out=0;
+	sv.done=0;
+	sv.fd=ed_fd();
+
+#ifdef TEMP_FP
+	fflush(cur_file.t_fp);
+#endif
+
+	if (pthread_create(&sv.t,NULL,sv_work,NULL))
+	{
+		fclose(sv.f);
+		wr_swap(filename,sv.name,-1);
+		free(sv.mem);
+
+		return 0;
+	}
+
+	sv.busy=1;
+
+#ifdef JOURNAL
+	/* the journal goes on with the old file until the new one is in
+		its place, the edits after here then go with the new one */
+	jn_put(0);
+	sv.jat=jn.fp ? ed_ftell(jn.fp) : (ed_off)sizeof(struct jn_head);
+#endif
+#ifdef DIRTY_SAVE
+	/* the runs count from what is being written, dx.st keeps the old
+		file so they are not trusted until sv_end */
+	dx_base();
+#endif
+
+	return 1;
+}
+
+#ifdef JOURNAL
+static int sv_fork(FILE **fpp,char **np)
+{
+	/* the journal for the new file, the edits made since it was copied,
+		1 if there are some, 0 if none, -1 if they could not be kept */
+	struct jn_head h;
+	char buf[4096];
+	char *name;
+	ed_off o,e;
+	FILE *fp=NULL;
+	int fd,r=0;
+
+	jn_put(0);
+
+	if (!jn.fp)
+	{
+		return jn.off ? -1 : 0;
+	}
+
+	if (fflush(jn.fp))
+	{
+		jn_lose();
+
+		return -1;
+	}
+
+	o=sv.jat;
+	e=ed_ftell(jn.fp);
+
+	if (e <= o)
+	{
+		return 0;
+	}
+
+	name=jn_path(sv.name);
+	fd=open(name,O_RDWR|O_CREAT|O_EXCL,0600);
+
+	if (fd >= 0)
+	{
+		fp=fdopen(fd,"w+");
+
+		if (!fp)
+		{
+			close(fd);
+		}
+	}
+
+	jn_head(sv.name,&h);
+
+	if (!fp || (fwrite(&h,sizeof(h),1,fp)!=1))
+	{
+		r=-1;
+	}
+
+	while (!r && (o < e))
+	{
+		long m=((e-o) > (ed_off)sizeof(buf)) ? (long)sizeof(buf) : (long)(e-o);
+
+		if ((pread(fileno(jn.fp),buf,m,o)!=m) || (fwrite(buf,1,m,fp)!=(size_t)m))
+		{
+			r=-1;
+		}
+
+		o+=m;
+	}
+
+	if (r || fflush(fp) || fsync(fileno(fp)))
+	{
+		if (fp) fclose(fp);
+		if (fd >= 0) unlink(name);
+		free(name);
+		jn_lose();
+
+		return -1;
+	}
+
+	*fpp=fp;
+	*np=name;
+
+	return 1;
+}
+#endif
+
+static int sv_need(ed_off pos,ed_off len)
+{
+	/* whether the save has still to read any of [pos,pos+len) of the
+		temp file, a len of -1 for the rest of it */
+	ed_off out,a,b;
+	int done;
+
+	if (!sv.busy)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&sv.lock);
+	out=sv.out;
+	done=sv.done;
+	pthread_mutex_unlock(&sv.lock);
+
+	if (done)
+	{
+		return 0;
+	}
+
+	a=(out < sv.lol) ? out : sv.lol;
+
+	if ((a < sv.lol) && (pos < sv.lol) && ((len < 0) || ((pos+len) > a)))
+	{
+		return 1;
+	}
+
+	b=out-sv.lol-sv.low-sv.high;
+
+	if (b < 0) b=0;
+
+	b+=sv.hip;
+
+	return (b < (sv.hip+sv.hil)) && (pos < (sv.hip+sv.hil)) && ((len < 0) || ((pos+len) > b));
+}
+
+static int sv_pct(void)
+{
+	/* how far the save has got, -1 if there is none */
+	ed_off out;
+
+	if (!sv.busy)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&sv.lock);
+	out=sv.out;
+	pthread_mutex_unlock(&sv.lock);
+
+	return sv.len ? (int)((out*100)/sv.len) : 100;
+}
+
+static void sv_hold(ed_off pos,ed_off len)
+{
+	while (sv_need(pos,len))
+	{
+		plot(menu_line,0);
+		co_str("saving, ");
+		printn((ed_off)sv_pct());
+		co_str("% written");
+		clear_line();
+		fflush(stdout);
+		menu_erased=1;
+
+		poll(NULL,0,SAVE_POLL);
+	}
+}
+
+static void sv_end(void)
+{
+	/* the thread is done, the file is the document as it was then */
+	int r;
+#ifdef JOURNAL
+	char *jname=NULL;
+	FILE *fp=NULL;
+	int j=0;
+#endif
+
+	if (!sv.busy)
+	{
+		return;
+	}
+
+	pthread_join(sv.t,NULL);
+	sv.busy=0;
+	free(sv.mem);
+	sv.mem=NULL;
+
+#ifdef JOURNAL
+	if (!sv.r)
+	{
+		j=sv_fork(&fp,&jname);
+	}
+#endif
+
+	/* the old file and its journal stay until the new one is whole */
+	r=wr_swap(filename,sv.name,sv.r);
+	sv.name=NULL;
+
+#ifdef DIRTY_SAVE
+	if (r || stat(filename,&dx.st))
+	{
+		dx_lose();
+	}
+#endif
+#ifdef JOURNAL
+	if (j > 0)
+	{
+		char *name=jn_path(filename);
+
+		if (r || rename(jname,name))
+		{
+			/* the old journal still has every edit */
+			fclose(fp);
+			unlink(jname);
+			free(name);
+
+			if (!r)
+			{
+				jn_lose();
+			}
+		}
+		else
+		{
+			fclose(jn.fp);
+			free(jn.name);
+			jn.fp=fp;
+			jn.name=name;
+			jn.dirty=0;
+			jn.synced=time(NULL);
+		}
+
+		free(jname);
+	}
+	else if (!j && !r)
+	{
+		/* the new file has every edit */
+		jn_end();
+	}
+#endif
+}
+
+static void sv_wait(void)
+{
+	sv_hold(0,-1);
+	sv_end();
+}
+
+static void sv_idle(void)
+{
+	/* while no key is waiting keep the progress on the status line */
+	while (sv.busy)
+	{
+		int done;
+
+		pthread_mutex_lock(&sv.lock);
+		done=sv.done;
+		pthread_mutex_unlock(&sv.lock);
+
+		if (done)
+		{
+			sv_end();
+		}
+
+		if (!mode)
+		{
+			show_status();
+			plot_cursor();
+			fflush(stdout);
+		}
+
+		if (done || (ev_wait(SAVE_POLL,-1) > 0) || winched)
+		{
+			break;
+		}
+	}
+}
+#endif /* SAVE_THREAD */
+
+#ifdef CLIP_SHM
+/* the clipboard shared by every editor of this user on the host, a
+	header then the text, writers hold an exclusive lock and readers
+	a shared one */
+struct clip_head
+{
+	char magic[8];
+	ed_off len;
+};
+
+static int clip_open(int flags,int lock)
+{
+	struct stat s;
+	char name[32];
+	int fd;
+
+	sprintf(name,"/aedit.clp.%lu",(unsigned long)getuid());
+
+	fd=shm_open(name,flags,0600);
+
+	/* the name can be guessed, so only one this user alone can use */
+	if ((fd >= 0) && (fstat(fd,&s) || (s.st_uid!=getuid())
+			|| ((s.st_mode&0777)!=0600) || flock(fd,lock)))
+	{
+		close(fd);
+		fd=-1;
+	}
+
+	return fd;
+}
+
+static int clip_stale(struct stat *s)
+{
+	/* whether ~/.aedit.clp has been written since, by an aedit
+		without the shared clipboard, in which case it wins */
+	struct stat f;
+
+	if (stat(clip_name,&f))
+	{
+		return 0;
+	}
+
+	if (f.st_mtime!=s->st_mtime)
+	{
+		return f.st_mtime > s->st_mtime;
+	}
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	return f.st_mtim.tv_nsec > s->st_mtim.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+static int clip_head(int fd,struct clip_head *h)
+{
+	if ((pread(fd,h,sizeof(*h),0)==sizeof(*h)) && !memcmp(h->magic,CLIP_MAGIC,sizeof(h->magic)))
+	{
+		return 0;
+	}
+
+	memset(h,0,sizeof(*h));
+
+	return -1;
+}
+
+static int clip_put(ed_off p,ed_off n)
+{
+	struct clip_head h;
+	FILE *f=NULL;
+	int fd=clip_open(O_RDWR|O_CREAT,LOCK_EX);
+	int d;
+
+	if (fd < 0) return -1;
+
+	memset(&h,0,sizeof(h));
+	memcpy(h.magic,CLIP_MAGIC,sizeof(h.magic));
+
+	/* empty until the text is all in */
+	if (!ftruncate(fd,CLIP_DATA)
+		&& (pwrite(fd,&h,sizeof(h),0)==sizeof(h))
+		&& ((d=dup(fd)) >= 0))
+	{
+		f=fdopen(d,"r+");
+
+		if (!f)
+		{
+			close(d);
+		}
+		else
+		{
+			if (!ed_fseek(f,CLIP_DATA,SEEK_SET))
+			{
+				ed_fput(f,p,n);
+
+				if (!fflush(f) && (ed_ftell(f)==(CLIP_DATA+n)))
+				{
+					h.len=n;
+				}
+			}
+
+			fclose(f);
+		}
+	}
+
+	if ((h.len==n) && (pwrite(fd,&h,sizeof(h),0)==sizeof(h)))
+	{
+		close(fd);
+
+		return 0;
+	}
+
+	/* no room, leave it to the file */
+	d=ftruncate(fd,0);
+	close(fd);
+
+	return -1;
+}
+
+static FILE *clip_get(ed_off *size)
+{
+	struct clip_head h;
+	struct stat s;
+	FILE *f=NULL;
+	int fd=clip_open(O_RDONLY,LOCK_SH);
+
+	if (fd < 0) return NULL;
+
+	/* the lock goes when the caller closes it */
+	if (!clip_head(fd,&h) && !fstat(fd,&s)
+		&& ((ed_off)s.st_size==(CLIP_DATA+h.len)) && !clip_stale(&s)
+		&& ((f=fdopen(fd,"r"))!=NULL))
+	{
+		if (!ed_fseek(f,CLIP_DATA,SEEK_SET))
+		{
+			*size=h.len;
+
+			return f;
+		}
+
+		fclose(f);
+
+		return NULL;
+	}
+
+	close(fd);
+
+	return NULL;
+}
+#endif /* CLIP_SHM */
+
+static void save_select(char *file)
+{
+	FILE *fptr;
+	ed_off i;
+	ed_off p=ed_pos();
+
+	if ((file==NULL) || !file[0]) return;
+
+	if (sel_pos==ed_pos()) return;
+
+	if (sel_pos > ed_pos()) 
+	{
+		i=sel_pos-p;
+	} 
+	else 
+	{
+		i=p-sel_pos;
+		p=sel_pos;
+	}
+
+#ifdef _WIN32
+	if (file == clip_name)
+	{
+		clipboard_write(ed_at, p, i);
+
+		return;
+	}
+#endif
+
+#ifdef CLIP_SHM
+	if ((file == clip_name) && !clip_put(p,i))
+	{
+		return;
+	}
+#endif
+
+	fptr=fopen(file,"w");
+
+#if defined(TEMP_FP) && !defined(_WIN32)
+	if ((fptr == NULL) && (file == clip_name))
+	{
+		if (clip_fp)
+		{
+			fclose(clip_fp);
+		}
+		clip_fp = tmpfile();
+		fptr = clip_fp;
+	}
+#endif /* TEMP_FP && !_WIN32 */
+
+	if (fptr) 
+	{
+		ed_fput(fptr,p,i);
+
+#if defined(TEMP_FP) && !defined(_WIN32)
+		if (fptr != clip_fp)
+#endif /* TEMP_FP && !_WIN32 */
+		{
+			fclose(fptr);
+		}
+	}
+}
+
+static char * enter_fname(char *fstr)
+{
+	int i=0,c,j;
+
+	menu_erased=1;
+
+	plot(menu_line,0);
+	co_str(fstr);
+	c=tty_col;
+	clear_line();
+	plot(menu_line,c);
+	fflush(stdout);
+
+	while (nl!=(c=getkey())) 
+	{
+		if ((c==13)|(c==escape)) break;
+		if (c > 0)
+		{
+			switch (c) 
+			{
+			case 8:
+			case key_del:
+			case 0x7f:
+				if (i) 
+				{
+					j=tty_col-1;
+					plot(menu_line,j);
+					clear_line();
+					i--;
+				}
+				break;
+			default:
+				get_fname[i++]=(char)c;
+				co(c);
+			}
+
+			fflush(stdout);
+		}
+	}
+
+	get_fname[i]=0;
+	if (!i) 
+	{
+		co_str(clip_name);
+		return clip_name;
+	}
+	return get_fname;
+}
+
+static void do_get(char *file)
+{
+	FILE *fptr = NULL;
+	ed_off p=ed_pos();
+	ed_off size=0;
+	struct stat s;
+
+	if ((file==NULL) || !file[0] || view_only) return;
+
+	if (file == clip_name)
+	{
+#ifdef _WIN32
+		long length = clipboard_length();
+
+		if (length < 1) return;
+
+		if (ed_reserve(length))
+		{
+			return;
+		}
+
+		fptr = clipboard_open();
+#else /* !_WIN32 */
+#	ifdef CLIP_SHM
+		fptr = clip_get(&size);
+
+		if (fptr && ed_reserve(size))
+		{
+			fclose(fptr);
+
+			return;
+		}
+#	endif /* CLIP_SHM */
+#	ifdef TEMP_FP
+		if (!fptr && clip_fp)
+		{
+			size=ed_ftell(clip_fp);
+
+			if (ed_reserve(size))
+			{
+				return;
+			}
+
+			fptr = clip_fp;
+			rewind(fptr);			
+		}
+#	endif /* TEMP_FP */
+#endif /* !_WIN32 */
+	}
+
+	if (!fptr)
+	{
+		if (stat(file, &s))
+		{
+			return;
+		}
+
+		if (ed_reserve((ed_off)s.st_size))
+		{
+			return;
+		}
+
+#ifdef SPAN_COPY
+		if (S_ISREG(s.st_mode))
+		{
+			size=(ed_off)s.st_size;
+		}
+#endif
+
+		fptr = fopen(file, "r");
+	}
+
+	if (!fptr) return;
+
+#ifdef JOB_CANCEL
+	if (size > 0)
+	{
+		/* a piece at a time so ESC can stop it */
+		ed_off n=0;
+
+		jb_start("reading");
+
+		while ((n < size) && !jb_look(n,size))
+		{
+			ed_off l=((size-n) > JOB_COPY) ? JOB_COPY : (size-n);
+			ed_off q=ed_pos();
+
+			ed_fget(fptr,l);
+
+			if ((ed_pos()-q) != l)
+			{
+				break;
+			}
+
+			n+=l;
+		}
+
+		if (jb_end() && (ed_pos() != p))
+		{
+			/* take back what came in */
+			ed_del(p-ed_pos());
+		}
+	}
+	else
+#endif
+	ed_fget(fptr,size);
+
+#if defined(TEMP_FP) && !defined(_WIN32)
+	if (fptr != clip_fp)
+#endif /* TEMP_FP && !_WIN32 */
+	{
+		fclose(fptr);
+	}
+
+	/* select what came in without moving back over it */
+	sel_pos=p;
+	sel_on=1;
+	find_cursor();
+	paint_text(p-ed_pos());
+	show_bottom(1);
+	plot_cursor();
+}
+
+void do_clipboard(int c)
+{
+	switch(c) 
+	{
+	case 'b':
+		save_select(clip_name);
+		paint_text(sel_pos-ed_pos());
+		break;
+	case 'c':
+		save_select(enter_fname("Copy text to - "));
+		paint_text(sel_pos-ed_pos());
+		break;
+	case 'p':
+		if (view_only)
 		{
-		case 'A':	
-			k=key_up; 
-			break;
-		case 'B':	
-			k=key_down; 
-			break;
-		case 'C':	
-			k=key_right; 
-			break;
-		case 'D':	
-			k=key_left; 
-			break;
-		case 'P':	
-			k=escape; 
+			paint_text(sel_pos-ed_pos());
 			break;
-		case '/':
-			k=co_getch();
-			k=ctrl_w;
-			guessing=0;	/* VT52 response, last should have been 'Z' */
+		}
+		save_select(enter_fname("Put text in - "));
+	case 'd':
+		if (view_only)
+		{
+			paint_text(sel_pos-ed_pos());
 			break;
-		case 'O':
-		case '[':
+		}
+		if (c=='d') save_select(clip_name);
+
+		if (sel_pos==ed_pos()) return;
+		if (sel_pos<ed_pos()) 
+		{
+			ed_off d=ed_pos()-sel_pos;
+			ed_del(-d);
+			if (sel_pos < page_start) 
 			{
-				int index=10;
-				int args[10];
+				find_cursor();
+				plot_cursor();
+			} 
+			else 
+			{
+				find_cursor();
+				plot_cursor();
+				/*	clear_end();*/
+				show_bottom(1);
+			}
+		} 
+		else 
+		{
+			ed_off d=sel_pos-ed_pos();
+			ed_del(d);
+			/* plot_cursor();*/
+			/*	clear_end();*/
+			show_bottom(1);
+		}
+		break;
+	default:
+		paint_text(sel_pos-ed_pos());
+		break;
+	}
+}
 
-				while (index)
-				{
-					index--;
-					args[index]=0;
-				}
+static struct
+{
+	int on;		/* search as the find string is typed */
+	char *label;	/* the prompt before the string */
+	long n;		/* prefixes that have been searched for */
+	ed_off at[max_cols+1];	/* where each was found, at[0] is the start */
+} fi;
 
-				do
-				{
-					k=co_getch();
+static void find_incr(long n);
 
-					switch (k) 
-					{
-						case 'A':	
-							k=key_up; 
-							break;
-						case 'B':	
-							k=key_down; 
-							break;
-						case 'C':	
-							k=key_right; 
-							break;
-						case 'D':	
-							k=key_left; 
-							break;
-						case 'P':	
-							k=escape; 
-							break;
-						case '~':
-							switch (args[0])
-							{
-							case 1:
-								return key_find;
-							case 2:
-								return key_ins;
-							case 3:
-								return key_del;
-							case 4:
-								return key_sel;
-							case 5:
-								return page_up;
-							case 6:
-								return page_down;
-							default:
-								k=escape;
-								break;
-							}
-							break;
-						case ';':
-							index++;
-							k=0;
-							break;
-						case 'R':
-							total_lines=args[0];
-							total_cols=args[1];
-							k=ctrl_w;
-							guessing=0;
-							break;
-						case 'c':
-							k=ctrl_w;
-							break;
-						default:
-							if ((k >= '0') & (k <= '9'))
-							{
-								args[index]*=10;
-								args[index]+=(k-'0');
-							}
+static long get_text_input(char *f_string)
+{
+	int i=0;
+	int c,k;
 
-							k=0;
-							break;
-					}
+	k=tty_col;
 
-				} while (k==0);
+	co_str(f_string);
+	co(0x22);
+	clear_line();
+	plot(menu_line,k);
+
+	fflush(stdout);
+
+	while (nl!=(c=getkey())) 
+	{
+		int j=0;
+		if ((c==13)|(c==escape)|(c==ctrl_z)|(c==key_home))
+			break;
+		if (c==key_ins) break;
+
+		if (c > 0)
+		{
+			switch(c) 
+			{
+			case key_del:
+			case 8:
+			case 0x7f:
+				if (i) 
+				{
+					i--;
+					j=tty_col-1;
+				} else {
+					j=k;
+				}
+				clear_line();
+				plot(menu_line,j);
+				break;
+			default:
+				if (!i) {
+					clear_line();
+					plot(menu_line,k);
+					}
+				f_string[i++]=(char)c;
+				co(c);
 			}
+			f_string[i]=0;
+			j=tty_col;
+			co(0x22);
+			plot(menu_line,j);
+			if (fi.on) find_incr(i);
+			fflush(stdout);
 		}
+	}
+	i=0;
+	while (f_string[i]) i++;
+	plot(menu_line,k+i);
+	menu_erased=1;
+
+	return i;
+}
+
+/*
+ * regular expressions for find and replace
+ *
+ * the pattern is compiled forwards and backwards into Thompson NFAs,
+ * a DFA is built from them a transition at a time while scanning so
+ * each byte is looked at once and nothing ever backtracks
+ *
+ * a DFA state is the list of NFA states still alive, grouped by where
+ * their match would have started, earliest first, which is enough to
+ * give the leftmost-longest match; the forward scan finds where it ends
+ * and an anchored scan of the reversed pattern finds where it starts
+ */
+
+#define RE_NODES	1024
+#define RE_SETS		64
+#define RE_STATES	256
+#define RE_POOL		16384
+#define RE_HASH		257
+
+#define RE_CHAR		0
+#define RE_SET		1
+#define RE_SPLIT	2
+#define RE_NOP		3
+#define RE_MATCH	4
+
+struct re_node
+{
+	short op,c,out,out1;
+};
+
+struct re_prog
+{
+	int start,bol,eol;
+	int s0;				/* idle unanchored state, or -1 */
+	int flushed;
+	int nstates,npool;
+	int *trans;			/* nstates by re_ncls, -1 until worked out */
+	short *pool;		/* NFA states of each DFA state, -1 between groups */
+	int *sidx,*slen,*snext;
+	char *sstop;		/* no more matches may start */
+	int head[RE_HASH];
+};
+
+static struct re_node re_node[RE_NODES];
+static int re_nnodes;
+static unsigned char re_set[RE_SETS][32];
+static int re_nsets;
+static unsigned char re_cls[256];	/* byte to equivalence class */
+static int re_ncls;
+static int re_rev;					/* building the reversed NFA */
+static char *re_err;
+static char re_pat[max_cols];
+static char re_case;				/* find_nocase when re_pat was built */
+static char re_lit[max_cols];		/* literal prefix for skipping ahead */
+static int re_nlit;
+static struct re_prog re_fwd,re_bwd;
+static short re_buf[RE_NODES*2];
+static short re_stack[RE_NODES*2];
+static int re_mark[RE_NODES];
+static int re_gen;
+
+static int re_new(int op,int c,int out,int out1)
+{
+	if (re_nnodes >= RE_NODES)
+	{
+		re_err="too complex";
+		return 0;
+	}
+
+	re_node[re_nnodes].op=(short)op;
+	re_node[re_nnodes].c=(short)c;
+	re_node[re_nnodes].out=(short)out;
+	re_node[re_nnodes].out1=(short)out1;
+
+	return re_nnodes++;
+}
+
+static int re_newset(unsigned char *s)
+{
+	int i=0;
+
+	while (i < re_nsets)
+	{
+		if (!memcmp(re_set[i],s,sizeof(re_set[i])))
+		{
+			return re_new(RE_SET,i,-1,-1);
+		}
+
+		i++;
+	}
+
+	if (re_nsets >= RE_SETS)
+	{
+		re_err="too many sets";
+		return 0;
+	}
+
+	memcpy(re_set[re_nsets],s,sizeof(re_set[0]));
+
+	return re_new(RE_SET,re_nsets++,-1,-1);
+}
+
+#define re_add(s,c)	((s)[(c)>>3]|=(unsigned char)(1<<((c)&7)))
+#define re_has(s,c)	((s)[(c)>>3]&(1<<((c)&7)))
+
+static void re_fold(unsigned char *s)
+{
+	/* both cases of every letter in the set */
+	int c;
+
+	for (c='a'; c <= 'z'; c++)
+	{
+		if (re_has(s,c) || re_has(s,c-0x20))
+		{
+			re_add(s,c);
+			re_add(s,c-0x20);
+		}
+	}
+}
+
+static int re_char(int c)
+{
+	if (find_nocase && (fold(c)!=unfold(c)))
+	{
+		unsigned char s[32];
+
+		memset(s,0,sizeof(s));
+		re_add(s,c);
+		re_fold(s);
+
+		return re_newset(s);
+	}
+
+	return re_new(RE_CHAR,c,-1,-1);
+}
+
+static void re_esc(unsigned char *s,int c)
+{
+	/* add what \c stands for to the set */
+	int i=0;
+	int neg=((c=='D')||(c=='W')||(c=='S'));
+	unsigned char t[32];
+
+	memset(t,0,sizeof(t));
+
+	switch (c)
+	{
+	case 'd':
+	case 'D':
+		for (i='0'; i<='9'; i++) re_add(t,i);
 		break;
-	case ctrl_s:	
-		k=key_left; 
-		break;
-	case ctrl_d:	
-		k=key_right; 
-		break;
-	case ctrl_x:	
-		k=key_down; 
-		break;
-	case ctrl_e:	
-		k=key_up; 
-		break;
-	case ctrl_q:
-		k=key_home;
-		break;
-	case ctrl_p:
-	case ctrl_u:
-	case ctrl_r:
-		k=page_up; 
-		break;
-	case ctrl_c:
-	case ctrl_n:	
-		k=page_down; 
-		break;
-#ifdef INTELLEC
-	case 0x1e:	
-		k=key_up; 
-		break;
-	case 0x1c:	
-		k=key_down; 
-		break;
-	case 0x14:	
-		k=key_right; 
-		break;
-	case 0x1f:	
-		k=key_left; 
-		break;
-	case 0x1d:	
-		k=key_home; 
-		break;
-#else
-#ifndef QNX
-	case 0x1e:	
-		k=key_up; 
+	case 'w':
+	case 'W':
+		for (i='0'; i<='9'; i++) re_add(t,i);
+		for (i='a'; i<='z'; i++) re_add(t,i);
+		for (i='A'; i<='Z'; i++) re_add(t,i);
+		re_add(t,'_');
 		break;
-#endif
-	case 0x1f:	
-		k=key_down; 
+	case 's':
+	case 'S':
+		re_add(t,' ');
+		re_add(t,tab);
+		re_add(t,nl);
+		re_add(t,'\r');
+		re_add(t,'\f');
+		re_add(t,'\v');
 		break;
-	case 0x1c:	
-		k=key_left; 
+	case 'n':
+		re_add(t,nl);
 		break;
-	case 0x1d:	
-		k=key_right; 
+	case 't':
+		re_add(t,tab);
 		break;
-#endif
-	case 0xa3:	
-		k&=0x7f; 
+	default:
+		re_add(t,c);
 		break;
 	}
 
-	if (!k) 
+	for (i=0; i < 32; i++)
 	{
-		switch (k=co_getch()) 
-		{
-		case 0x3b: 
-			k=escape; 
-			break;
-		case 0x47: 
-			k=key_start; 
-			break;
-		case 0x48: 
-			k=key_up; 
-			break;
-		case 0x49: 
-			k=page_up; 
-			break;
-		case 0x4B: 
-			k=key_left; 
-			break;
-		case 0x4C: 
-			k=key_home; 
-			break;
-		case 0x4D: 
-			k=key_right; 
-			break;
-		case 0x4F: 
-			k=key_end; 
-			break;
-		case 0x50: 
-			k=key_down; 
-			break;
-		case 0x51: 
-			k=page_down; 
-			break;
-		case 0x52: 
-			k=key_ins; 
-			break;
-		case 0x53: 
-			k=key_del; 
-			break;
-		}
+		s[i]|=neg ? (unsigned char)~t[i] : t[i];
 	}
+}
 
-	if (k==key_home) 
+struct re_frag
+{
+	int s,e;	/* entry and the node whose out is still to be filled */
+};
+
+static struct re_frag re_alt(char **pp);
+
+static struct re_frag re_cat(struct re_frag a,struct re_frag b)
+{
+	if (re_rev)
 	{
-		switch (k=getkey()) 
-		{
-		case key_up: 
-			k=page_up; 
-			break;
-		case key_down: 
-			k=page_down; 
-			break;
-		case key_left: 
-			k=key_start; 
-			break;
-		case key_right: 
-			k=key_end; 
-			break;
-		case key_home: 
-			k=escape; 
-			break;
-		}
+		struct re_frag t=a;
+		a=b;
+		b=t;
 	}
 
-	return k;
+	re_node[a.e].out=(short)b.s;
+	a.e=b.e;
+
+	return a;
 }
 
-static void co(int c)
+static struct re_frag re_atom(char **pp)
 {
-	int i;
-	switch (c) 
+	struct re_frag f;
+	unsigned char s[32];
+	unsigned char *p=(unsigned char *)*pp;
+	int c=*p++;
+
+	memset(s,0,sizeof(s));
+
+	switch (c)
 	{
-	case nl:
-		putchar(13);
-		putchar(c);
-		tty_col=0;
-		tty_row++;
+	case '(':
+		*pp=(char *)p;
+		f=re_alt(pp);
+		p=(unsigned char *)*pp;
+		if (*p!=')')
+		{
+			re_err="missing )";
+		}
+		else
+		{
+			p++;
+		}
+		*pp=(char *)p;
+		return f;
+	case '.':
+		memset(s,0xff,sizeof(s));
+		s[nl>>3]&=(unsigned char)~(1<<(nl&7));
+		f.s=f.e=re_newset(s);
 		break;
-	default:
-#ifndef REVERSE
-		if (rev_on==2) c='#';
-#endif
-		if (c<32) c='?'; 
-		else if (c>126) c='?';
-		putchar(c);
-		tty_col++;
-		if ((c!=' ') | rev_on) 
+	case '[':
 		{
-			if (tty_col > chars_per_line[tty_row]) 
+			int neg=0;
+			int first=1;
+
+			if (*p=='^')
 			{
-				chars_per_line[tty_row]=tty_col;
+				neg=1;
+				p++;
 			}
-		}
-		if (tty_col > last_col) 
-		{ 
-			if (wordwrap) 
+
+			while (*p && ((*p!=']') || first))
 			{
-				tty_col=0; 
-				tty_row++;
-			} 
-			else 
+				c=*p++;
+				first=0;
+
+				if ((c=='\\') && *p)
+				{
+					re_esc(s,*p++);
+					continue;
+				}
+
+				if ((*p=='-') && p[1] && (p[1]!=']'))
+				{
+					int d=p[1];
+					p+=2;
+					while (c <= d)
+					{
+						re_add(s,c);
+						c++;
+					}
+					continue;
+				}
+
+				re_add(s,c);
+			}
+
+			if (*p!=']')
 			{
-				tty_col=last_col;
+				re_err="missing ]";
+			}
+			else
+			{
+				p++;
+			}
+
+			if (find_nocase)
+			{
+				re_fold(s);
+			}
+
+			if (neg)
+			{
+				for (c=0; c < 32; c++) s[c]=(unsigned char)~s[c];
+				s[nl>>3]&=(unsigned char)~(1<<(nl&7));
+			}
+
+			f.s=f.e=re_newset(s);
+		}
+		break;
+	case '\\':
+		if (*p)
+		{
+			c=*p++;
+			if (strchr("dDwWsS",c))
+			{
+				re_esc(s,c);
+				f.s=f.e=re_newset(s);
+				break;
 			}
+			if (c=='n') c=nl;
+			if (c=='t') c=tab;
 		}
+		f.s=f.e=re_char(c);
+		break;
+	case '*':
+	case '+':
+	case '?':
+		re_err="nothing to repeat";
+		f.s=f.e=re_new(RE_NOP,0,-1,-1);
+		break;
+	default:
+		f.s=f.e=re_char(c);
 		break;
 	}
-	if (tty_row > menu_line) 
+
+	*pp=(char *)p;
+
+	return f;
+}
+
+static struct re_frag re_star(struct re_frag a,int min)
+{
+	/* a* or with min a+ */
+	int e=re_new(RE_NOP,0,-1,-1);
+	int s=re_new(RE_SPLIT,0,a.s,e);
+
+	re_node[a.e].out=(short)s;
+
+	if (!min)
 	{
-		tty_row=menu_line;
-		i=0;
-		while (i < menu_line) 
+		a.s=s;
+	}
+
+	a.e=e;
+
+	return a;
+}
+
+static struct re_frag re_quest(struct re_frag a)
+{
+	int e=re_new(RE_NOP,0,-1,-1);
+
+	re_node[a.e].out=(short)e;
+	a.s=re_new(RE_SPLIT,0,a.s,e);
+	a.e=e;
+
+	return a;
+}
+
+static int re_count(char **pp,int *n,int *m)
+{
+	/* {n}, {n,} or {n,m}, leaves *pp alone if it is none of them */
+	char *p=*pp+1;
+
+	*n=*m=0;
+
+	if ((*p < '0') || (*p > '9')) return 0;
+	while ((*p >= '0') && (*p <= '9')) *n=(*n*10)+(*p++-'0');
+
+	if (*p==',')
+	{
+		p++;
+		if (*p=='}')
 		{
-			chars_per_line[i]=chars_per_line[i+1];
-			i++;
+			*m=-1;
+		}
+		else
+		{
+			if ((*p < '0') || (*p > '9')) return 0;
+			while ((*p >= '0') && (*p <= '9')) *m=(*m*10)+(*p++-'0');
+		}
+	}
+	else
+	{
+		*m=*n;
+	}
+
+	if (*p!='}') return 0;
+	if ((*n > 255) || (*m > 255) || ((*m >= 0) && (*m < *n))) return 0;
+
+	*pp=p+1;
+
+	return 1;
+}
+
+static struct re_frag re_piece(char **pp)
+{
+	char *a=*pp;
+	struct re_frag f=re_atom(pp);
+
+	while (!re_err)
+	{
+		int n,m;
+
+		switch (**pp)
+		{
+		case '*':
+			f=re_star(f,0);
+			break;
+		case '+':
+			f=re_star(f,1);
+			break;
+		case '?':
+			f=re_quest(f);
+			break;
+		case '{':
+			if (re_count(pp,&n,&m))
+			{
+				/* build the copies by reading the atom again */
+				char *q=*pp;
+				int i=1;
+
+				if (!n)
+				{
+					if (m < 0)
+					{
+						f=re_star(f,0);
+					}
+					else if (m)
+					{
+						f=re_quest(f);
+					}
+					else
+					{
+						f.s=f.e=re_new(RE_NOP,0,-1,-1);
+					}
+				}
+				else while (i < n)
+				{
+					*pp=a;
+					f=re_cat(f,re_atom(pp));
+					i++;
+				}
+
+				if ((m < 0) && n)
+				{
+					*pp=a;
+					f=re_cat(f,re_star(re_atom(pp),0));
+				}
+
+				while (i < m)
+				{
+					*pp=a;
+					f=re_cat(f,re_quest(re_atom(pp)));
+					i++;
+				}
+
+				*pp=q;
+				continue;
+			}
+		default:
+			return f;
 		}
-		chars_per_line[menu_line]=0;
-		menu_erased=1;
+
+		(*pp)++;
 	}
-}
 
-static void co_str(char *p)
-{
-	while (*p) co(*p++);
+	return f;
 }
 
-static int next_tab(int i)
+static struct re_frag re_alt(char **pp)
 {
-	i/=tabs;
-	i++;
-	i*=tabs;
-	return i;
-}
+	struct re_frag f;
+	int first=1;
 
-static int next_col(int c,int ch)
-{
-	if (ch==nl) return 0;
-	if (ch==tab) return next_tab(c);
-	if (c>=last_col) 
+	f.s=f.e=re_new(RE_NOP,0,-1,-1);
+
+	while (!re_err)
 	{
-		return 0;
+		if (!**pp || (**pp==')'))
+		{
+			break;
+		}
+
+		if (**pp=='|')
+		{
+			int s,e;
+			struct re_frag g;
+
+			(*pp)++;
+			g=re_alt(pp);
+			e=re_new(RE_NOP,0,-1,-1);
+			s=re_new(RE_SPLIT,0,f.s,g.s);
+			re_node[f.e].out=(short)e;
+			re_node[g.e].out=(short)e;
+			f.s=s;
+			f.e=e;
+			break;
+		}
+
+		if (first)
+		{
+			f=re_piece(pp);
+			first=0;
+		}
+		else
+		{
+			f=re_cat(f,re_piece(pp));
+		}
 	}
-	return (c+1);
+
+	return f;
 }
 
-static char *sprintn(long u,char *p)
+static int re_closure(int n,int i)
 {
-	long v;
+	/* add the NFA states reachable from i without reading to re_buf[n...] */
+	int sp=0;
 
-	v=u/10;
-	if (v) p=sprintn(v,p);
-	v=u%10;
-	*p++=(char)('0'+v);
-	*p=0;
-	return p;
-}
+	re_stack[sp++]=(short)i;
 
-static void printn(long u)
-{
-	char buf[10];
-	sprintn(u,buf);
-	co_str(buf);
+	while (sp)
+	{
+		i=re_stack[--sp];
+
+		if ((i < 0) || (re_mark[i]==re_gen))
+		{
+			continue;
+		}
+
+		re_mark[i]=re_gen;
+
+		switch (re_node[i].op)
+		{
+		case RE_SPLIT:
+			re_stack[sp++]=re_node[i].out1;
+			re_stack[sp++]=re_node[i].out;
+			break;
+		case RE_NOP:
+			re_stack[sp++]=re_node[i].out;
+			break;
+		default:
+			re_buf[n++]=(short)i;
+			break;
+		}
+	}
+
+	return n;
 }
 
-static void reverse(int i)
+static int re_group(int s,int n)
 {
-	if (!(rev_on | i)) return;
-
-	if (i==4) return;
+	/* sort the new group re_buf[s..n) so equal states look equal */
+	int i,j;
 
-	rev_on=i;
-#ifdef REVERSE
-#ifdef ANSI_SYS
-	if (i) 
+	for (i=s+1; i < n; i++)
 	{
-		co_puts("\033[7m");
-	} 
-	else 
+		short t=re_buf[i];
+
+		for (j=i; (j > s) && (re_buf[j-1] > t); j--)
 		{
-		co_puts("\033[0m");						 /* was 0 */
+			re_buf[j]=re_buf[j-1];
+		}
+
+		re_buf[j]=t;
 	}
-#else /* ANSI_SYS */
-	if (i) 
+
+	if (n > s)
 	{
-		co_puts("\033(");
-	} 
-	else 
-		{
-		co_puts("\033)");
+		re_buf[n++]=-1;
 	}
-#endif /* ANSI_SYS */
-#else /* REVERSE */
-	if (rev_on==3) 
+
+	return n;
+}
+
+static void re_flush(struct re_prog *r)
+{
+	int i;
+
+	r->nstates=0;
+	r->npool=0;
+	r->s0=-1;
+
+	for (i=0; i < RE_HASH; i++)
 	{
-		if ((mode=='b')|(mode=='d')) rev_on=2;
+		r->head[i]=-1;
 	}
-#endif /* REVERSE */
 }
 
-static void clear_line(void)
+static int re_state(struct re_prog *r,int n,int stop)
 {
-	int rev,i,j,k;
+	/* find or add the DFA state held in re_buf[0..n) */
+	unsigned h=(unsigned)stop;
+	int i;
 
-	rev=rev_on;
-	if (rev) reverse(0);
+	if (n && (re_buf[n-1] < 0)) n--;
 
-	j=i=tty_col;
-	k=tty_row;
+	for (i=0; i < n; i++)
+	{
+		h=(h*31)+(unsigned)re_buf[i];
+	}
 
-	if (chars_per_line[k] > i) i=chars_per_line[k];
-	if (k>=menu_line) 
+	h%=RE_HASH;
+
+	for (i=r->head[h]; i >= 0; i=r->snext[i])
 	{
-		if (i>last_col) i=last_col;
-		if (j>last_col) j=last_col;
+		if ((r->slen[i]==n) && (r->sstop[i]==stop)
+			&& !memcmp(r->pool+r->sidx[i],re_buf,n*sizeof(re_buf[0])))
+		{
+			return i;
+		}
 	}
-	i-=j;
-#ifdef ERASE_LINE
-	if (i) 
+
+	if ((r->nstates >= RE_STATES) || ((r->npool+n) > RE_POOL))
 	{
-#ifdef ANSI_SYS
-		co_puts("\033[K");
-#else /* ANSI_SYS */
-		co_puts("\033K");
-#endif /* ANSI_SYS */
+		/* cache is full, start again, the caller only holds this state */
+		re_flush(r);
+		r->flushed=1;
 	}
-#else /* ERASE_LINE */
-	while (i--) co(' ');
-#endif /* ERASE_LINE */
-	
-	chars_per_line[k]=j;
 
-	if (rev) reverse(rev);
+	i=r->nstates++;
+	r->sidx[i]=r->npool;
+	r->slen[i]=n;
+	r->sstop[i]=(char)stop;
+	memcpy(r->pool+r->npool,re_buf,n*sizeof(re_buf[0]));
+	r->npool+=n;
+	r->snext[i]=r->head[h];
+	r->head[h]=i;
+	memset(r->trans+(i*re_ncls),0xff,re_ncls*sizeof(int));
+
+	return i;
 }
 
-#ifdef PLOT_CTRL
-static void plot_ctrl(int r,int c)
+static int re_init(struct re_prog *r,int stop)
 {
-	char plot_buf[20];
-#ifdef ANSI_SYS
-	char num_buf[10];
+	/* the state before anything is read */
+	int n;
 
-	strcpy(plot_buf,"\033[");
-	sprintn((long)(r+1),num_buf);
-	strcat(plot_buf,num_buf);
-	strcat(plot_buf,";");
-	sprintn((long)(c+1),num_buf);
-	strcat(plot_buf,num_buf);
-	strcat(plot_buf,"H");
-#else /* ANSI_SYS */
-	char *p;
-	p=plot_buf;
-	*p++=(char)0x1b;
-	*p++=(char)'Y';
-	*p++=(char)32+r;
-	*p++=(char)32+c;
-	*p=0;
-#endif /* ANSI_SYS */
-	co_puts(plot_buf);
-	tty_row=r; 
-	tty_col=c;
-}
-#endif
+	re_gen++;
+	n=re_group(0,re_closure(0,r->start));
 
-#ifndef PLOT_CTRL
-int mag(i)
-int i;
-{
-	if (i<0) return -i;
-	return i;
+	return re_state(r,n,stop);
 }
-#endif /* PLOT_CTRL */
 
-#ifdef SCROLL_RGN
-static void scrol_rgn(int r,int c)
+static int re_accept(struct re_prog *r,int s,int c)
 {
-	char scr_buf[20];
-	char num_buf[10];
+	/* the group that has matched, if a match may end before c */
+	short *g=r->pool+r->sidx[s];
+	int n=r->slen[s];
+	int i;
 
-	strcpy(scr_buf,"\033[");
-	if (r != -1)
+	if (r->eol && (c >= 0) && (c!=nl))
 	{
-		sprintn((long)(r+1),num_buf);
-		strcat(scr_buf,num_buf);
+		return -1;
 	}
-	strcat(scr_buf,";");
-	if (c != -1)
+
+	for (i=0; i < n; i++)
 	{
-		sprintn((long)(c+1),num_buf);
-		strcat(scr_buf,num_buf);
+		if ((g[i] >= 0) && (re_node[g[i]].op==RE_MATCH))
+		{
+			while ((i < n) && (g[i] >= 0)) i++;
+			return i;
+		}
 	}
-	strcat(scr_buf,"r");
-	co_puts(scr_buf);
-	tty_row=(-1); 
-	tty_col=(-1);
-	plot_ctrl(0,0);
+
+	return -1;
 }
-#endif
 
-static void plot(int r,int c)
+static int re_step(struct re_prog *r,int s,int c)
 {
-	if ((tty_row==r)&(tty_col==c)) return;
+	/* work out the transition from s on c, bit 0 of
+		the result says a match ended just before c */
+	int m=re_accept(r,s,c);
+	int stop=r->sstop[s];
+	int n=0,k=0,i,len;
+	short *g=r->pool+r->sidx[s];
 
-#ifndef PLOT_CTRL
+	if (m >= 0)
 	{
-		int x,y;
-
-		if ((!c) & (r>tty_row)) co(nl);
-
-		x=mag(tty_col-c);
-		y=mag(tty_row-r);
-
-		if ((x+y) > (c+r)) home();
-
-		while (r > tty_row) cud();
-		while (r < tty_row) cuu();
-		while (c > tty_col) cuf();
-		while (c < tty_col) cub();
+		/* later starts lose to this one */
+		stop=1;
+		len=m;
+	}
+	else
+	{
+		len=r->slen[s];
 	}
-#else /* PLOT_CTRL */
-	plot_ctrl(r,c);
-#endif /* PLOT_CTRL */
-}
 
-static void show_block(long q,long i,int endrow)
-{
-	if (row >= endrow) return;
+	re_gen++;
 
-	while (i--) 
+	for (i=0; i <= len; i++)
 	{
-		int c;
+		int j;
 
-		c=ed_at(q++);
+		if ((i==len) || (g[i] < 0))
+		{
+			n=re_group(k,n);
+			k=n;
+			continue;
+		}
 
-		if (c==nl) 
+		j=g[i];
+
+		switch (re_node[j].op)
 		{
-			clear_line();
-			row++;
-			plot(row,0);
-			col=0;
-			if (row>=endrow) return;
-		} 
-		else 
-			{
-			if (c==tab) 
-			{
-				int j;
-				j=next_tab(col)-col;
-				while (j--) 
-				{
-					co(' ');
-					col++;
-				}
-			} 
-			else 
+		case RE_CHAR:
+			if ((unsigned char)re_node[j].c==c)
 			{
-				co(c);
-				col++;
+				n=re_closure(n,re_node[j].out);
 			}
-			if (col > last_col) 
-			{ 
-				col=0;
-				row++;
-#ifdef PLOT_CTRL
-				plot(row,col);
-#else
-				if (!wordwrap) plot(row,col);
-#endif
-				if (row>=endrow) return;
+			break;
+		case RE_SET:
+			if (re_has(re_set[re_node[j].c],c))
+			{
+				n=re_closure(n,re_node[j].out);
 			}
+			break;
 		}
 	}
-}
-
-static void show_text(long pos,long len,int endrow)
-{
-	long inv_start,inv_end,k,l;
 
-	inv_start=inv_end=0;
-	if (sel_on) 
+	if (!stop && (!r->bol || (c==nl)))
 	{
-		inv_start=sel_pos;
-		inv_end=ed_pos();
-		if (inv_start > inv_end) 
-		{
-			inv_start=ed_pos();
-			inv_end=sel_pos;
-		}
+		n=re_group(n,re_closure(n,r->start));
 	}
-	k=pos+len;
-	if (inv_start < pos) inv_start=pos;
-	if (inv_start > k) inv_start=k;
-	if (inv_end < pos) inv_end=pos;
-	if (inv_end > k) inv_end=k;
 
-	l=inv_start-pos;
-	if (l) show_block(pos,l,endrow);
-	l=inv_end-inv_start;
-	if (l) 
+	r->flushed=0;
+	i=(re_state(r,n,stop) << 1)|(m >= 0);
+
+	if (!r->flushed)
 	{
-		reverse(3);
-		show_block(inv_start,l,endrow);
-		reverse(0);
+		/* unless s has just been thrown away remember the way */
+		r->trans[(s*re_ncls)+re_cls[c]]=i;
 	}
-	l=k-inv_end;
-	if (l) show_block(inv_end,l,endrow);
+
+	return i;
 }
 
-static void show_top(void)
+static void re_free(struct re_prog *r)
 {
-	row=col=0;
-	plot(row,col);
-	show_text(page_start,ed_pos()-page_start,status_line);
-	crsr_row=row;
-	crsr_col=col;
+	if (r->trans) free(r->trans);
+	if (r->pool) free(r->pool);
+	if (r->sidx) free(r->sidx);
+	if (r->slen) free(r->slen);
+	if (r->snext) free(r->snext);
+	if (r->sstop) free(r->sstop);
+
+	r->trans=NULL;
+	r->pool=NULL;
+	r->sidx=r->slen=r->snext=NULL;
+	r->sstop=NULL;
 }
 
-static void show_bottom(int erase_after)
+static int re_alloc(struct re_prog *r)
 {
-	plot(row=crsr_row,col=crsr_col);
-	show_text(ed_pos(),ed_len()-ed_pos(),status_line);
-	/*	if (row < status_line) co('|');*/
-	if (erase_after) 
+	r->trans=malloc(RE_STATES*re_ncls*sizeof(int));
+	r->pool=malloc(RE_POOL*sizeof(short));
+	r->sidx=malloc(RE_STATES*sizeof(int));
+	r->slen=malloc(RE_STATES*sizeof(int));
+	r->snext=malloc(RE_STATES*sizeof(int));
+	r->sstop=malloc(RE_STATES);
+
+	if (!(r->trans && r->pool && r->sidx && r->slen && r->snext && r->sstop))
 	{
-		if (row < status_line) clear_line();
+		re_free(r);
+		return -1;
+	}
 
-		row++;
+	re_flush(r);
 
-		while (row < status_line) 
-		{
-			if (chars_per_line[row])
-			{
-				plot(row,0);
-				clear_line();
-			}
-			/*		co_str("\n");*/
-			row++;
-		}
-	}
-	if (erase_after != 2) plot(row=crsr_row,col=crsr_col);
-	fflush(stdout);
+	return 0;
 }
 
-static void scan_pos(long i)
+static void re_classes(void)
 {
-	long p=page_start;
-	row=col=0;
-	while (i--) 
+	/* bytes that every set treats alike share a class so the
+		transition tables stay small, literals and newline stand alone */
+	unsigned char lit[32];
+	int rep[256];
+	int c,i,k;
+
+	memset(lit,0,sizeof(lit));
+	re_add(lit,nl);
+
+	for (i=0; i < re_nnodes; i++)
 	{
-		int c;
-		if (p >= ed_len()) 
+		if (re_node[i].op==RE_CHAR)
 		{
-			return;
+			re_add(lit,re_node[i].c);
 		}
+	}
 
-		c=ed_at(p++);
-
-		col=next_col(col,c);
+	re_ncls=0;
 
-		if (col==0)
+	for (c=0; c < 256; c++)
+	{
+		for (k=0; k < re_ncls; k++)
 		{
-			row++;
+			int d=rep[k];
 
-			if (row >= status_line)
+			if (re_has(lit,c) || re_has(lit,d))
 			{
-				return;
+				continue;
+			}
+
+			for (i=0; i < re_nsets; i++)
+			{
+				if (!re_has(re_set[i],c) != !re_has(re_set[i],d))
+				{
+					break;
+				}
+			}
+
+			if (i==re_nsets)
+			{
+				break;
 			}
 		}
+
+		if (k==re_ncls)
+		{
+			rep[re_ncls++]=c;
+		}
+
+		re_cls[c]=(unsigned char)k;
 	}
 }
 
-static void paint_text(long len)
+static void re_build(struct re_prog *r,char *p,int rev)
 {
-	long i;
+	struct re_frag f;
 
-	if (len==0) return;
+	re_rev=rev;
+	f=re_alt(&p);
 
-	if (len < 0) 
-	{
-		i=ed_pos()+len;
-		if (i < page_start) i=page_start;
-		i-=page_start;
-		scan_pos(i);
-		plot(row,col);
-		show_text(page_start+i,ed_pos()-page_start-i,status_line);
-	} 
-	else 
+	if (*p && !re_err)
 	{
-		scan_pos(ed_pos()-page_start);
-		plot(row,col);
-		show_text(ed_pos(),len,status_line);
+		re_err="unmatched )";
 	}
+
+	r->start=f.s;
+	re_node[f.e].out=(short)re_new(RE_MATCH,0,-1,-1);
 }
 
-static void ed_fmove(long i)
+static int re_compile(char *pat)
 {
-#ifdef _DEBUG
-	if (cur_file.low_size+cur_file.high_size)
+	/* ready the pattern for re_find and re_rfind, keeps the
+		DFAs already built if it has not changed */
+	char buf[max_cols];
+	char *p=buf;
+	size_t n;
+	int i,bol=0,eol=0;
+
+	if (re_fwd.trans && !strcmp(pat,re_pat) && (re_case==find_nocase))
 	{
-#if defined(_WIN32) && defined(_M_IX86)
-		__asm int 3
-#endif
+		return 0;
 	}
-	printf("ed_fmove(%ld)\n",i);
-#endif
 
-	if (i)
+	re_free(&re_fwd);
+	re_free(&re_bwd);
+	re_pat[0]=0;
+	re_nnodes=0;
+	re_nsets=0;
+	re_nlit=0;
+	re_err=NULL;
+
+	strcpy(buf,pat);
+
+	if (*p=='^')
 	{
-		if (i > 0)
-		{
-			/* move higher to lower */
+		bol=1;
+		p++;
+	}
 
-#ifdef _DEBUG
-			if (i > cur_file.t_hil)
-			{
-#if defined(_WIN32) && defined(_M_IX86)
-				__asm int 3;
-#endif
-			}
-#endif
-			while (i)
-			{
-				long l=i;
+	n=strlen(p);
 
-				if (l > cur_file.buf_size) 
-				{
-					l=cur_file.buf_size;
-				}
+	if (n && (p[n-1]=='$'))
+	{
+		/* unless it is escaped */
+		size_t k=n-1;
 
-				ed_seek(cur_file.t_hip);
-				ed_read(cur_file.buffer,l);
+		while (k && (p[k-1]=='\\')) k--;
 
-				cur_file.t_hip+=l;
-				cur_file.t_hil-=l;
+		if (!((n-1-k) & 1))
+		{
+			eol=1;
+			p[n-1]=0;
+		}
+	}
 
-				ed_seek(cur_file.t_lol);
-				ed_write(cur_file.buffer,l);
+	re_build(&re_fwd,p,0);
+	re_build(&re_bwd,p,1);
 
-				cur_file.t_lol+=l;
+	if (!re_err)
+	{
+		re_gen++;
+		n=re_closure(0,re_fwd.start);
 
-				i-=l;
-			}
-		}
-		else
+		while (n--)
 		{
-			i=(-i);
-
-#ifdef _DEBUG
-			if (i > cur_file.t_lol)
+			if (re_node[re_buf[n]].op==RE_MATCH)
 			{
-#if defined(_WIN32) && defined(_M_IX86)
-				__asm int 3;
-#endif
+				re_err="matches nothing";
 			}
-#endif
+		}
+	}
 
-			/* move lower to higher */
+	if (re_err)
+	{
+		return -1;
+	}
 
-			while (i)
-			{
-				long l=i;
+	re_fwd.bol=re_bwd.eol=bol;
+	re_fwd.eol=re_bwd.bol=eol;
 
-				if (l > cur_file.buf_size)
-				{
-					l=cur_file.buf_size;
-				}
+	re_classes();
 
-				ed_seek(cur_file.t_lol-l);
-				ed_read(cur_file.buffer,l);
+	if (re_alloc(&re_fwd) || re_alloc(&re_bwd))
+	{
+		re_free(&re_fwd);
+		re_free(&re_bwd);
+		re_err="out of memory";
+		return -1;
+	}
 
-				cur_file.t_lol-=l;
+	/* the bytes every match has to begin with */
+	i=re_fwd.start;
 
-				ed_seek(cur_file.t_hip-l);
-				ed_write(cur_file.buffer,l);
+	while ((!bol) && (re_nlit < (int)sizeof(re_lit)))
+	{
+		re_gen++;
 
-				cur_file.t_hip-=l;
-				cur_file.t_hil+=l;
-				i-=l;
-			}
+		if ((re_closure(0,i)!=1) || (re_node[re_buf[0]].op!=RE_CHAR))
+		{
+			break;
 		}
+
+		re_lit[re_nlit++]=(char)re_node[re_buf[0]].c;
+		i=re_node[re_buf[0]].out;
 	}
-}
 
-static void ed_move(long i)
-{
-	/* if +ve add text to lower section, else move to upper half */
+	strcpy(re_pat,pat);
+	re_case=find_nocase;
 
-	ADBG_POS(ed_pos());
-	ADBG_LEN(ed_len());
+	return 0;
+}
 
-	ADBG_MOVE(i)
+static ed_off re_run(struct re_prog *r,ed_off p,ed_off lim,int stop)
+{
+	/* scan from p towards lim, returning where the best match ended
+		or -1, new matches may start along the way unless stop */
+	ed_off best=-1;
+	int fwd=(lim >= p);
+	int idle=fwd && !stop && !r->bol && re_nlit;
+	int s,c;
 
-	if (i) 
+	if (stop)
 	{
-		char *p,*q;
+		s=re_init(r,1);
+	}
+	else
+	{
+		if (fwd)
+		{
+			c=p ? ed_at(p-1) : nl;
+		}
+		else
+		{
+			c=(p < ed_len()) ? ed_at(p) : nl;
+		}
 
-		p=cur_file.buffer;
-		p+=cur_file.low_size;
-		q=cur_file.buffer;
-		q+=(cur_file.buf_size-cur_file.high_size);
+		if (idle)
+		{
+			r->s0=re_init(r,0);
+		}
 
-		if (i < 0) 
+		if (r->bol && (c!=nl))
 		{
-			i=(-i);
+			s=re_state(r,0,0);
+		}
+		else
+		{
+			s=re_init(r,0);
+		}
+	}
 
-			if (i > cur_file.low_size)
-			{
-				/* flush memory buffer totally */
-				ed_dump(0L);
+	while (p != lim)
+	{
+		ed_off start;
+		long n;
+		unsigned char *b;
 
-				ed_fmove(-i);
+		if (fwd)
+		{
+			b=(unsigned char *)ed_span(p,&start,&n);
+			n-=(long)(p-start);
+			b+=p-start;
+			if (n > (lim-p)) n=(long)(lim-p);
+		}
+		else
+		{
+			b=(unsigned char *)ed_span(p-1,&start,&n);
+			n=(long)(p-start);
+			b+=n;
+			if (n > (p-lim)) n=(long)(p-lim);
+		}
 
-				i=ed_room();
-				i>>=1;
-				ed_load(i);
-				ed_load(-i);
-			}
-			else
-			{
-				cur_file.high_size+=i;
-				cur_file.low_size-=i;
+#ifdef JOB_CANCEL
+		if (n > JOB_SPAN) n=JOB_SPAN;
 
-#ifdef _WIN32
-				if (cur_file.high_size < 0)
-				{
-#if defined(_WIN32) && defined(_M_IX86)
-					__asm int 3
-#endif
-				}
-				if (cur_file.low_size < 0)
-				{
-#if defined(_WIN32) && defined(_M_IX86)
-					__asm int 3;
-#endif
-				}
+		if (jb_step(fwd ? p : ed_len()-p,ed_len()))
+		{
+			return -1;
+		}
 #endif
 
-				while (i--) *--q=(*--p);
-			}
-		} 
-		else 
+		while (n)
 		{
-			if (i > cur_file.high_size)
+			int t;
+
+			if (idle && (s==r->s0))
 			{
-				ed_dump(0L);
-				ed_fmove(i);
+				/* nothing under way, skip to where one could start */
+				unsigned char *q=memchr(b,re_lit[0],(size_t)n);
 
-				i=ed_room();
-				i>>=1;
-				ed_load(i);
-				ed_load(-i);
+				if (!q)
+				{
+					p+=n;
+					break;
+				}
+
+				p+=q-b;
+				n-=(long)(q-b);
+				b=q;
 			}
-			else
+
+			c=fwd ? *b++ : *--b;
+			n--;
+
+			t=r->trans[(s*re_ncls)+re_cls[c]];
+
+			if (t < 0)
 			{
-				cur_file.high_size-=i;
-				cur_file.low_size+=i;
+				t=re_step(r,s,c);
 
-#ifdef _WIN32
-				if (cur_file.high_size < 0)
-				{
-#if defined(_WIN32) && defined(_M_IX86)
-					__asm int 3
-#endif
-				}
-				if (cur_file.low_size < 0)
+				if (r->flushed && idle)
 				{
-#if defined(_WIN32) && defined(_M_IX86)
-					__asm int 3
-#endif
+					r->s0=re_init(r,0);
 				}
-#endif
+			}
 
-				while (i--) *p++=(*q++);
+			if (t & 1)
+			{
+				best=p;
+			}
+
+			s=t >> 1;
+			p+=fwd ? 1 : -1;
+
+			if (r->sstop[s] && !r->slen[s])
+			{
+				return best;
 			}
 		}
 	}
+
+	if (fwd)
+	{
+		c=(lim < ed_len()) ? (0xff & ed_at(lim)) : -1;
+	}
+	else
+	{
+		c=lim ? (0xff & ed_at(lim-1)) : -1;
+	}
+
+	if (re_accept(r,s,c) >= 0)
+	{
+		best=lim;
+	}
+
+	return best;
 }
 
-static void show_mopt(char **list,int opt)
+static ed_off re_find(ed_off p,long *len)
 {
-int i=0;
-int pm=0;
-
-	plot(menu_line,0);
+	/* the first match at or after p */
+	ed_off e=re_run(&re_fwd,p,ed_len(),0);
+	ed_off s;
 
-	while (list[i])
+	if (e < 0)
 	{
-		i++;
+		return -1;
 	}
 
-	if (opt >= i)
+	s=re_run(&re_bwd,e,p,1);
+	*len=(long)(e-s);
+
+	return s;
+}
+
+static ed_off re_rfind(ed_off p,long *len)
+{
+	/* the last match that ends at or before p */
+	ed_off s=re_run(&re_bwd,p,0,0);
+	ed_off e;
+
+	if (s < 0)
 	{
-		opt=0;
+		return -1;
 	}
 
-	while (opt < i)
+	e=re_run(&re_fwd,s,p,1);
+	*len=(long)(e-s);
+
+	return s;
+}
+
+/*
+ * several strings at once
+ *
+ * the patterns go into a trie whose missing edges are filled in
+ * from the fail links, giving an Aho-Corasick DFA over byte classes
+ * that looks at each byte once however many patterns there are
+ */
+
+static void ac_free(void)
+{
+	if (ac.next) free(ac.next);
+	if (ac.term) free(ac.term);
+	if (ac.link) free(ac.link);
+	if (ac.text) free(ac.text);
+	if (ac.pat) free(ac.pat);
+	if (ac.len) free(ac.len);
+
+	memset(&ac,0,sizeof(ac));
+}
+
+static int ac_state(void)
+{
+	/* a new state with no edges yet */
+	int i;
+
+	if (ac.states==ac.size)
 	{
-		char *p=list[opt];
-		size_t k=strlen(p);
+		int n=ac.size ? 2*ac.size : 256;
+		int *a=realloc(ac.next,(size_t)n*ac.ncls*sizeof(a[0]));
 
-		if ((tty_col+10+9) > total_cols)
+		if (a) ac.next=a;
+		a=a ? realloc(ac.term,n*sizeof(a[0])) : NULL;
+		if (a) ac.term=a;
+		a=a ? realloc(ac.link,n*sizeof(a[0])) : NULL;
+
+		if (!a)
 		{
-			break;
+			return -1;
 		}
 
-		opt++;
-
-		co_str("  ");
-		co_str(p);
-		k=10-k-2;
-		while (k--) co(' ');
-		pm++;
+		ac.link=a;
+		ac.size=n;
 	}
 
-	while (tty_col < (last_col-9))
+	for (i=0; i < ac.ncls; i++)
 	{
-		co(' ');
+		ac.next[ac.states*ac.ncls+i]=0;
 	}
 
-	if (pm < i)
-	{
-		menu_nxt=opt;
-		co_str("--more--");
-	}
-	else
-	{
-		menu_nxt=0;
-	}
+	ac.term[ac.states]=-1;
+	ac.link[ac.states]=0;
 
-	while (tty_col < last_col)
-	{
-		co(' ');
-	}
+	return ac.states++;
 }
 
-char *menu_d[]={"Again","Block","Delete","Find","-find","Get","Insert","Jump","Length","Quit","Replace","?replace","Shell","View","Xchange",NULL};
-char *menu_b[]={"Buffer","Copy","Delete","Put",NULL};
-char *menu_q[]={"Abort","Exit","Init","Update","Write",NULL};
-
-static void show_status(void)
+static char *ac_compile(char *s)
 {
-#if defined(_WIN32) && defined(_M_IX86)
-/*	if (!menu_erased)
-	{
-		__asm int 3;
-	}*/
-#endif
-
-	plot(status_line,0);
+	/* the patterns are split by | or are the lines of the file
+		named after an @, returns why not */
+	long n=0;
+	char *p;
+	int *fail,*queue;
+	int i,k,head,tail;
 
-	menu_erased=0;
+	ac_free();
 
-	switch (mode) 
+	if (*s=='@')
 	{
-	case 'i':
-		break;
-	default:
-		co_str(" ---- ");
-		if (filename) 
-		{
-			co_str(filename);
-		} 
-/*		else 
+		char line[max_cols];
+		FILE *fp=fopen(s+1,"r");
+
+		if (!fp)
 		{
-			co_str("(untitled)");
-		}*/
+			return "cannot open patterns";
+		}
 
-		if (show_size) 
+		while (fgets(line,sizeof(line),fp))
 		{
-			long i=ed_len();
-	/*		if (i==cur_file.buf_size) 
-			{
-				co(' ');
-				reverse(1);
-				co_str("full");
-				reverse(0);
-			}*/
-			if (filename) co_str(", ");
-			if (show_size==2) 
-			{
-				co_str("saving...");
-			} 
-			else 
+			long l=(long)strlen(line);
+
+			while (l && ((line[l-1]==nl) || (line[l-1]==13))) line[--l]=0;
+
+			p=realloc(ac.text,n+l+1);
+
+			if (!p)
 			{
-				printn(i);
-				co_str(" bytes");
-	/*			printn(cur_file.buf_size-i);
-				co_str(" free");*/
+				fclose(fp);
+				ac_free();
+				return "out of memory";
 			}
-			show_size=0;
+
+			ac.text=p;
+			memcpy(p+n,line,l+1);
+			n+=l+1;
 		}
+
+		fclose(fp);
 	}
-	clear_line();
-	plot(menu_line,0);
-	switch (mode) 
+	else
 	{
-	case 'i':
-		co_str("[insert]");
-		break;
-	case 'x':
-		co_str("[exchange]");
-		break;
-	case 'b':
-	case 'd':
-		reverse(rev_menu);
-		show_mopt(menu_b,0);
-		reverse(0);
-		break;
-	case 'q':
-		reverse(rev_menu);
-		show_mopt(menu_q,0);
-		reverse(0);
-		break;
-	default:
-		reverse(rev_menu);
-		show_mopt(menu_d,menu_id);
-		reverse(0);
+		n=(long)strlen(s)+1;
+		ac.text=malloc(n);
+
+		if (!ac.text)
+		{
+			return "out of memory";
+		}
+
+		memcpy(ac.text,s,n);
+
+		for (p=ac.text; *p; p++)
+		{
+			if (*p=='|') *p=0;
+		}
 	}
-	clear_line();
-}
 
-static void cls(void)
-{
-	int i;
-#ifdef ANSI_SYS
-	co_puts("\033[H\033[2J");
-#else
-	co_puts("\033H\033J");
-#endif
-	tty_row=tty_col=i=0;
-	while (i < total_lines) chars_per_line[i++]=0;
-	menu_erased=1;
-}
+	for (p=ac.text; p < (ac.text+n); p+=strlen(p)+1)
+	{
+		if (*p) ac.npat++;
+	}
 
-static int init(char *fname,FILE *fptr)
-{
-	int c;
+	if (!ac.npat)
+	{
+		ac_free();
+		return "no patterns";
+	}
 
-	c=0;
-	while (c < total_lines) chars_per_line[c++]=total_cols;
+	ac.pat=malloc(ac.npat*sizeof(ac.pat[0]));
+	ac.len=malloc(ac.npat*sizeof(ac.len[0]));
+	ac.ncls=1;
+	ac.c0=-1;
 
-	if (filename)
+	if ((!ac.pat) || (!ac.len))
 	{
-		free(filename);
-		filename=NULL; 
+		ac_free();
+		return "out of memory";
 	}
 
-	crsr_row=crsr_col=0;
-	cur_file.low_size=page_start=0L;
-	cur_file.high_size=0;
+	/* bytes no pattern has share class 0 */
+	for (p=ac.text,k=0; p < (ac.text+n); p+=strlen(p)+1)
+	{
+		if (*p)
+		{
+			int c0=fold(0xff & *p);
+			char *q;
 
-	cur_file.t_hip=0;
-	cur_file.t_hil=0;
-	cur_file.t_lol=0;
-	cur_file.t_calen=0;
-	cur_file.t_capos=0;
+			ac.pat[k]=p;
+			ac.len[k]=(long)strlen(p);
+			if (ac.len[k] > ac.maxlen) ac.maxlen=ac.len[k];
 
-	if (fname)
+			if (!find_nocase) c0=0xff & *p;
+			ac.first[c0]=1;
+			ac.first[find_nocase ? unfold(c0) : c0]=1;
+			if (!k) ac.c0=c0;
+			if (ac.c0!=c0) ac.c1=-1;
+
+			for (q=p; *q; q++)
+			{
+				int c=0xff & *q;
+
+				if (find_nocase) c=fold(c);
+
+				if (!ac.cls[c])
+				{
+					ac.cls[c]=(short)ac.ncls;
+					if (find_nocase) ac.cls[unfold(c)]=(short)ac.ncls;
+					ac.ncls++;
+				}
+			}
+
+			k++;
+		}
+	}
+
+	if (ac.c1 < 0)
 	{
-		filename=strdup(fname);
+		ac.c0=-1;
+	}
+	else
+	{
+		ac.c1=find_nocase ? unfold(ac.c0) : ac.c0;
 	}
 
-#ifdef CLEAR_SCREEN
-	cls();
-#else
-#ifndef ERASE_LINE
+	/* the trie */
+	if (ac_state() < 0)
 	{
-		int i;
-		i=max_lines << 1;
-		while (i--) co(nl);
+		ac_free();
+		return "out of memory";
 	}
-#else
-	home();
-#endif
-#endif
-	show_status();
-	plot(0,0);
-	fflush(stdout);
 
-	if (!filename) 
+	for (k=0; k < ac.npat; k++)
 	{
-		show_bottom(1);
-		fflush(stdout);
-		return 0;
+		int t=0;
+
+		for (p=ac.pat[k]; *p; p++)
+		{
+			int x=ac.cls[0xff & *p];
+
+			if (!ac.next[t*ac.ncls+x])
+			{
+				i=ac_state();
+
+				if (i < 0)
+				{
+					ac_free();
+					return "out of memory";
+				}
+
+				ac.next[t*ac.ncls+x]=i;
+			}
+
+			t=ac.next[t*ac.ncls+x];
+		}
+
+		if (ac.term[t] < 0) ac.term[t]=k;
 	}
 
-	if (!fptr) 
+	/* breadth first, each state's fail is shallower so its row
+		is already complete when the missing edges are copied */
+	fail=malloc(ac.states*sizeof(fail[0]));
+	queue=malloc(ac.states*sizeof(queue[0]));
+
+	if ((!fail) || (!queue))
 	{
-		show_bottom(1);
-		fflush(stdout);
-		return 0;
+		if (fail) free(fail);
+		if (queue) free(queue);
+		ac_free();
+		return "out of memory";
 	}
 
-	ed_seof(cur_file.t_hip);
-	ed_seek(cur_file.t_hip);
+	head=tail=0;
 
-	while (forever)
+	for (i=0; i < ac.ncls; i++)
 	{
-		int i=(int)fread(cur_file.t_cache,1,sizeof(cur_file.t_cache),fptr);
-		if (i > 0)
+		int t=ac.next[i];
+
+		if (t)
 		{
-			long l=i;
-			ed_write(cur_file.t_cache,l);
+			fail[t]=0;
+			queue[tail++]=t;
+		}
+	}
 
-			ADBG_MINS(cur_file.t_cache,l)
+	while (head < tail)
+	{
+		int t=queue[head++];
+		int f=fail[t];
 
-			cur_file.t_hil+=l;
-		}
-		else
+		ac.link[t]=(ac.term[f] >= 0) ? f : ac.link[f];
+
+		for (i=0; i < ac.ncls; i++)
 		{
-			break;
+			int u=ac.next[t*ac.ncls+i];
+
+			if (u)
+			{
+				fail[u]=ac.next[f*ac.ncls+i];
+				queue[tail++]=u;
+			}
+			else
+			{
+				ac.next[t*ac.ncls+i]=ac.next[f*ac.ncls+i];
+			}
 		}
 	}
 
-	ed_tzap();
+	free(fail);
+	free(queue);
 
-	fclose(fptr);
-	ed_move(-ed_pos());
-	ed_load(cur_file.buf_size);
-	show_size=1;
-	show_status();
-	show_top();
-	show_bottom(1);
-	fflush(stdout);
-	return 0;
-}      
+	for (i=0; i < (ac.states*ac.ncls); i++)
+	{
+		int t=ac.next[i];
 
-static void plot_cursor(void)
-{
-	plot(crsr_row,crsr_col);
+		ac.next[i]=((t*ac.ncls) << 1) | ((ac.term[t] >= 0) || ac.link[t]);
+	}
+
+	return NULL;
 }
 
-static void write_file(char *fn)
+static ed_off ac_find(ed_off p,long *len,int *which)
 {
-#ifdef _DEBUG
-	long i=ed_len();
-	long p=0;
-	while (i--)
+	/* the leftmost match at or after p, the longest if several
+		start there */
+	ed_off best=-1;
+	int r=0;
+
+	while ((p < ed_len()) && ((best < 0) || (p < (best+ac.maxlen))))
 	{
-		ed_at(p);
-		p++;
-	}
-#else
-	FILE *f;
+		ed_off st;
+		long n;
+		unsigned char *b=(unsigned char *)ed_span(p,&st,&n);
+		unsigned char *z=b+n;
 
-	if (!fn) return;
-	if (!fn[0]) return;
+		b+=p-st;
 
-	f=fopen(fn,"w");
-	if (f) 
-	{
-		long i=ed_len();
-		long p=0;
-		while (i--)
+#ifdef JOB_CANCEL
+		if ((z-b) > JOB_SPAN) z=b+JOB_SPAN;
+
+		if (jb_step(p,ed_len()))
 		{
-			int c=ed_at(p);
-			putc(c,f);
-			p++;
+			return -1;
 		}
-		fclose(f);
-	}
 #endif
-}
 
+		while (b < z)
+		{
+			int t;
 
-#ifndef PLOT_CTRL
+			if ((!r) && (best < 0))
+			{
+				/* nothing under way, skip to where one could start */
+				unsigned char *q=b;
 
-cuu()
-{
-	tty_row--;
-#ifdef ANSI_SYS
-	co_puts("\033[A");
-#else
-	co_puts("\033A");
-#endif
-}
+				if (ac.c0 >= 0)
+				{
+					q=(unsigned char *)find_first((char *)b,(char *)z,ac.c0,ac.c1);
+				}
+				else
+				{
+					while ((q < z) && !ac.first[*q]) q++;
+				}
 
-cud()
-{
-	tty_row++;
-#ifdef ANSI_SYS
-	co_puts("\033[B");
-#else
-	co_puts("\033B");
-#endif
-}
+				if ((!q) || (q==z))
+				{
+					p+=z-b;
+					break;
+				}
 
-cuf()
-{
-	tty_col++;
-#ifdef ANSI_SYS
-	co_puts("\033[C");
-#else
-	co_puts("\033C");
-#endif
-}
+				p+=q-b;
+				b=q;
+			}
 
-cub()
-{
-	tty_col--;
-#ifdef ANSI_SYS
-	co_puts("\033[D");
-#else
-	co_puts("\033D");
-#endif
-}
+			t=ac.next[r+ac.cls[*b++]];
+			r=t >> 1;
+			p++;
 
-home()
-{
-	tty_row=tty_col=0;
-#ifdef ANSI_SYS
-	co_puts("\033[H");
-#else
-	co_puts("\033H");
-#endif
-}
-#endif
+			if (t & 1)
+			{
+				/* longest first, so the earliest start first */
+				int looked=0;
 
+				t=r/ac.ncls;
 
-static void move_right(void)
-{
-	if (ed_pos()!=ed_len()) 
-	{
-		ed_move(1L);
-		if (sel_on) paint_text(-1L);
-	}
-}
+				if (ac.term[t] < 0) t=ac.link[t];
 
-static void move_left(void)
-{
-	if (ed_pos()) 
-	{
-		ed_move(-1L);
-		if (sel_on) paint_text(1L);
+				while (t)
+				{
+					int k=ac.term[t];
+					ed_off m=p-ac.len[k];
+
+					if ((best >= 0) && ((m > best) || ((m==best) && (ac.len[k] <= *len))))
+					{
+						break;
+					}
+
+					if (find_word)
+					{
+						looked=1;
+
+						if (!word_ok(m,ac.len[k]))
+						{
+							t=ac.link[t];
+							continue;
+						}
+					}
+
+					best=m;
+					*len=ac.len[k];
+					*which=k;
+					break;
+				}
+
+				if (looked)
+				{
+					/* the span may have gone */
+					break;
+				}
+			}
+
+			if ((best >= 0) && (p >= (best+ac.maxlen)))
+			{
+				break;
+			}
+		}
 	}
+
+	return best;
 }
 
-static void show_line(void)
+static int match_string(ed_off p,char *q,long i)
 {
-	long p=ed_pos();
-	long i,j;
-	j=0;
-	i=ed_len()-p;
 	while (i--) 
 	{
 		int c=ed_at(p++);
-		if (c==nl) 
+		int d=*q++;
+
+		if (find_nocase)
 		{
-			i=0;
-		} 
-		else 
+			c=fold(c);
+			d=fold(d);
+		}
+
+		if (c!=d) 
 		{
-			j++;
+			return 0;
 		}
 	}
+	return 1;
+}
 
-	if (j) show_text(ed_pos(),j,status_line);
-	clear_line();
+static int find_at(ed_off p,long n)
+{
+	return match_string(p,f_string,n) && ((!find_word) || word_ok(p,n));
 }
 
-/* upto CR but not including it */
+#ifdef FIND_PARALLEL
+struct find_slot
+{
+	ed_off lo,hi;	/* matches looked for start in [lo,hi) */
+	ed_off count;	/* greedy matches found, up to the limit */
+	ed_off first,second,last;
+	ed_off lines;	/* of the matches after the first, those a newline before */
+	int head,tail;	/* a newline before the first and after the last */
+	int done;
+};
 
-static long line_len(long p)
+static struct
 {
-	long i=0;
-	long j=ed_len()-p;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	ed_off base,end,limit;
+	long chunks,next,merged;
+	int lines;
+	struct find_slot slot[FIND_SLOTS];
+} find_pool={PTHREAD_MUTEX_INITIALIZER,PTHREAD_COND_INITIALIZER};
+
+static int find_pword(ed_off m,long n)
+{
+	/* word_ok for the workers */
+	char t[1];
 
-	while (j--)
+	if (m && is_word(0xff & *ed_pget(m-1,1,t)))
 	{
-		if (ed_at(p++)==nl)
-		{
-			break;
-		}
-
-		i++;
+		return 0;
 	}
 
-	return i;
+	return ((m+n) >= ed_len()) || !is_word(0xff & *ed_pget(m+n,1,t));
 }
 
-static void delete_char(void)
+static void find_scan(ed_off pos,ed_off hi,ed_off lim,struct find_slot *r,char *buf)
 {
-	int new_line=0;
-	long pos=ed_pos();
+	/* non overlapping matches of f_string starting in [pos,hi),
+		stops after lim of them, noting newlines between them when
+		lines are being counted */
+	long n=(long)strlen(f_string);
+	int c0=(unsigned char)f_string[0];
+	int c1=c0;
+	ed_off t=pos;
+	int seen=0;
+	char pat[max_cols];
 
-	if (!pos) return;
+	if (find_nocase)
+	{
+		fold_str(pat,f_string);
+		c0=fold(c0);
+		c1=unfold(c0);
+	}
 
-	row=crsr_row;
-	col=crsr_col;
+	r->count=0;
+	r->first=-1;
+	r->second=-1;
+	r->last=-1;
+	r->lines=0;
+	r->head=0;
+	r->tail=0;
 
-	if (!col) 
-	{
-		new_line=1;
-	} 
-	else 
+	while ((pos < hi) && !find_stop)
 	{
-		long p=ed_pos()-1;
-		long i=line_len(p);
+		ed_off e=pos+FIND_WIN;
+		ed_off to;
+		char *w,*q,*z;
 
-		while (i--) 
+		if (e > hi) e=hi;
+
+		w=ed_pget(pos,(long)(e-pos)+n-1,buf);
+		q=w;
+		z=w+(e-pos);
+
+		while ((q < z) && ((q=find_first(q,z,c0,c1)) != NULL))
 		{
-			int c=ed_at(p++);
-			col=next_col(col,c);
-			if (!col)
+			if ((find_nocase ? fold_cmp(q+1,pat+1,n-1) : memcmp(q+1,f_string+1,n-1))
+				|| (find_word && !find_pword(pos+(q-w),n)))
 			{
-				new_line=1;
-				i=0;
+				q++;
+			}
+			else
+			{
+				ed_off m=pos+(q-w);
+
+				if (find_pool.lines)
+				{
+					if ((!seen) && memchr(w+(t-pos),nl,(size_t)(m-t)))
+					{
+						seen=1;
+					}
+
+					if (!r->count)
+					{
+						r->head=seen;
+					}
+					else
+					{
+						if (seen) r->lines++;
+					}
+
+					seen=0;
+					t=m;
+				}
+
+				if (!r->count) r->first=m;
+				if (r->count==1) r->second=m;
+				r->last=m;
+
+				if ((++r->count)==lim)
+				{
+					return;
+				}
+
+				q+=n;
 			}
 		}
-	}
 
-	/* could add a special case, -
-		if we are deleting character at <0,0>
-		then paint the previous line
-		at the current line */
+		to=(q && (q > z)) ? pos+(q-w) : e;
 
-	ed_del(-1L);
+		if (find_pool.lines && (!seen) && memchr(w+(t-pos),nl,(size_t)(to-t)))
+		{
+			seen=1;
+		}
 
-	find_cursor();
-	plot_cursor();
-	row=crsr_row; 
-	col=crsr_col;
-	if (new_line) 
+		t=to;
+		pos=to;
+	}
+
+	if (r->count)
 	{
-		/*	clear_end();*/
-		show_bottom(1);
-		/*	show_status();*/
-	} 
-	else 
+		r->tail=seen;
+	}
+	else
 	{
-		show_line();
-		plot_cursor();
+		r->head=seen;
 	}
 }
 
-static long sl_phys(long p)
+static void *find_work(void *arg)
 {
-	/* this returns the start of this line by going back to a previous CR */
-	while (p)
+	/* worker, takes the next chunk while there is a slot for it */
+	sigset_t s;
+
+	sigfillset(&s);
+	pthread_sigmask(SIG_BLOCK,&s,NULL);
+
+	pthread_mutex_lock(&find_pool.lock);
+
+	while (forever)
 	{
-		p--;
+		long i=find_pool.next;
+		struct find_slot *r=find_pool.slot+(i % FIND_SLOTS);
+		ed_off lo,hi;
 
-		while (ed_at(p)==nl)
+		if (find_stop || (i >= find_pool.chunks))
 		{
-			p++;
+			break;
+		}
 
-			return p;
+		if (i >= (find_pool.merged+FIND_SLOTS))
+		{
+			pthread_cond_wait(&find_pool.cond,&find_pool.lock);
+			continue;
 		}
-	}
 
-	return p;
-}
+		find_pool.next++;
 
-static long sl_prev(long p)
-{
-	/* previous actual line start */
+		pthread_mutex_unlock(&find_pool.lock);
 
-	p=sl_phys(p);
+		lo=find_pool.base+(ed_off)i*FIND_CHUNK;
+		hi=lo+FIND_CHUNK;
+		if (hi > find_pool.end) hi=find_pool.end;
 
-	if (p)
-	{
-		p--;
+		find_scan(lo,hi,find_pool.limit,r,arg);
+		r->lo=lo;
+		r->hi=hi;
 
-		p=sl_phys(p);
+		pthread_mutex_lock(&find_pool.lock);
+
+		r->done=1;
+
+		ev_wake();
 	}
 
-	return p;
+	pthread_mutex_unlock(&find_pool.lock);
+
+	return NULL;
 }
 
-static long next_log(long p)
+static int find_par(ed_off p,ed_off lim,ed_off *found,ed_off *count,ed_off *lines)
 {
-	/* find next line either by start of newline, or wrapped the columns */
-	int c=0;
-	long i=ed_len()-p;	/* see how many characters left */
+	/* the lim'th match from p or the last if there are fewer, with
+		the document split into chunks scanned on worker threads and
+		merged in order, and how many lines the matches start on if
+		asked, returns -1 if the workers could not start */
+	pthread_t t[FIND_THREADS];
+	long n=(long)strlen(f_string);
+	long nt=sysconf(_SC_NPROCESSORS_ONLN),i;
+	long w=FIND_WIN+max_cols;
+	char *bufs;
+	ed_off c=0,k=-1,e=p,ln=0;
+	int busy=1,seen=0;
 
-	while (i--)
-	{
-		int ch=ed_at(p++);
+	if (nt > FIND_THREADS) nt=FIND_THREADS;
+	if (nt < 1) nt=1;
 
-		c=next_col(c,ch);
+	bufs=malloc((nt+1)*w);
 
-		if (!c)
-		{
-			break;
-		}
+	if (!bufs)
+	{
+		return -1;
 	}
 
-	return p;
-}
+#ifdef HAVE_MMAP
+	if (cur_file.t_mstale)
+	{
+		ed_map();
+	}
+#endif
 
-static long prev_log(long p)
-{
-	/* previous line as seen on the VDU */
-	long l=sl_prev(p);
+	find_stop=0;
+	find_pool.base=p;
+	find_pool.end=ed_len()-n+1;
+	find_pool.limit=lim+1;
+	find_pool.chunks=(long)((find_pool.end-p+FIND_CHUNK-1)/FIND_CHUNK);
+	find_pool.next=0;
+	find_pool.merged=0;
+	find_pool.lines=(lines != NULL);
 
-	while (l < p)
+	for (i=0; i < FIND_SLOTS; i++)
 	{
-		long m=next_log(l);
-		if (m < p)
-		{
-			l=m;
-		}
-		else
+		find_pool.slot[i].done=0;
+	}
+
+	for (i=0; i < nt; i++)
+	{
+		if (pthread_create(t+i,NULL,find_work,bufs+i*w))
 		{
 			break;
 		}
 	}
 
-	return l;
-}
+	if (!(nt=i))
+	{
+		free(bufs);
+		return -1;
+	}
 
-static long sl_this(long p)
-{
-	long q=sl_phys(p);
-	int col=0;
-	long i=ed_len()-q;
-	long m=q;
+	pthread_mutex_lock(&find_pool.lock);
 
-	while (i--)
+	while (busy && (find_pool.merged < find_pool.chunks))
 	{
-		if (q >= p)
-		{
-			break;
-		}
-		else
+		struct find_slot *r=find_pool.slot+(find_pool.merged % FIND_SLOTS);
+		struct find_slot m;
+
+		if (!r->done)
 		{
-			int c=ed_at(q++);
+			long d=find_pool.merged;
 
-			col=next_col(col,c);
+			pthread_mutex_unlock(&find_pool.lock);
 
-			if (col==0)
+			if (jb_keys(FIND_POLL) || jb_look(d,find_pool.chunks))
 			{
-				m=q;
+				k=-1;
+				c=0;
+				busy=0;
 			}
+
+			pthread_mutex_lock(&find_pool.lock);
+			continue;
 		}
-	}
 
-	return m;
-}
+		m=*r;
+		r->done=0;
+		find_pool.merged++;
+		pthread_cond_broadcast(&find_pool.cond);
+		pthread_mutex_unlock(&find_pool.lock);
 
-static int col_at(long p)
-{
-	long q=sl_this(p);
-	int col=0;
-	long i=p-q;
+		if (m.count && (m.first < e))
+		{
+			/* the last match ran into this chunk, its own greedy run
+				still holds if it resumes at the second match */
+			struct find_slot s;
 
-	while (i--)
-	{
-		char c=(char)ed_at(q++);
+			find_scan(e,m.hi,1,&s,bufs+nt*w);
 
-		col=next_col(col,c);
-	}
+			if ((!find_pool.lines) && (m.count > 1) && (s.first==m.second))
+			{
+				m.count--;
+				m.first=m.second;
+			}
+			else
+			{
+				find_scan(e,m.hi,lim-c+1,&m,bufs+nt*w);
+			}
+		}
 
-	return col;
-}
+		if (m.count)
+		{
+			if ((k < 0) || seen || m.head)
+			{
+				ln++;
+			}
 
-#ifdef NEED_ROW_AT
-static int row_at(long p)
-{
-	int row=0;
-	int col=0;
-	long q=page_start;
-	long i=p-q;
-	if (p < page_start) return -1;
+			ln+=m.lines;
+			seen=m.tail;
 
-	while (i--)
-	{
-		int c=ed_at(q++);
+			if ((c+m.count) >= lim)
+			{
+				k=m.first;
 
-		col=next_col(col,c);
+				if ((lim-c) > 1)
+				{
+					find_scan(m.first,m.hi,lim-c,&m,bufs+nt*w);
+					k=m.last;
+				}
 
-		if (!col)
-		{
-			row++;
+				c=lim;
+				busy=0;
+			}
+			else
+			{
+				c+=m.count;
+				k=m.last;
+				e=k+n;
+			}
 		}
-
-		if (row > (last_text+1))
+		else
 		{
-			i=0;
+			if (m.head) seen=1;
 		}
-	}
 
-	return row;
-}
-#endif
+		pthread_mutex_lock(&find_pool.lock);
+	}
 
-void repage(void)
-{
-	int r=5;
-	page_start=ed_pos();
+	find_stop=1;
+	pthread_cond_broadcast(&find_pool.cond);
+	pthread_mutex_unlock(&find_pool.lock);
 
-	while (r) 
+	while (nt--)
 	{
-		page_start=prev_log(page_start);
+		pthread_join(t[nt],NULL);
+	}
 
-		r--;
+	find_stop=0;
 
-		if (!page_start) r=0;
-	}
+	free(bufs);
 
-	/*	if (menu_erased) show_status();*/
-	show_top();
-	show_bottom(2);
-	if (menu_erased) show_status();
-	plot_cursor();
-}
+	*found=k;
 
-#ifdef SCROLL_RGN
-static void scrol_up(void)
-{
-	int i;
-	scrol_rgn(0,last_text);
-	plot_ctrl(last_text,0);
-	co_puts("\033E"); /* next line */
-	scrol_rgn(0,menu_line);
-	plot_ctrl(last_text,0);
-	i=0;
-	while (i < last_text)
+	if (count)
 	{
-		chars_per_line[i]=chars_per_line[i+1];
-		i++;
+		*count=c;
 	}
-	chars_per_line[i]=0;
-}
 
-static void scrol_down(void)
-{
-	int i;
-	scrol_rgn(0,last_text);
-	plot_ctrl(0,0);
-	co_puts("\033M");
-	scrol_rgn(0,menu_line);
-	plot_ctrl(0,0);
-	i=last_text;
-	while (i--)
+	if (lines)
 	{
-		chars_per_line[i+1]=chars_per_line[i];
+		*lines=ln;
 	}
-	chars_per_line[0]=0;
+
+	return 0;
 }
 #endif
 
-static void find_cursor(void)
+static ed_off find_seq(ed_off p,long len)
 {
-	if (page_start > ed_pos()) 
+	/* the literal find string looked for in this thread, the last
+		place it can start is where it just fits before the end */
+	ed_off e=ed_len()-len+1;
+	int c0=(unsigned char)f_string[0];
+	int c1=c0;
+
+	if (find_nocase)
 	{
-#ifdef SCROLL_RGN
-		if (page_start > ed_len())
-		{
-			repage();
-		}
-		else
-		{
-			long prev=prev_log(page_start);
-			if (prev_log(page_start) <= ed_pos())
-			{
-				long i=0;
-				scrol_down();
-				plot(0,0);
-				row=0;
-				col=0;
-				i=page_start-prev;	/* howmany to paint */
-				page_start=prev;
-				show_text(page_start,page_start+i,1);
-			}
-			else
-			{
-				repage();
-			}
-		}
-#else
-		repage();
-#endif
+		c0=fold(c0);
+		c1=unfold(c0);
 	}
 
-	while (forever)
+	while (p < e)
 	{
-		long p=page_start;
-		long i=ed_pos()-page_start;
-
-		row=col=0;
-
-		while (i--) 
-		{
-			int c=ed_at(p++);
-
-			col=next_col(col,c);
-
-			if (!col)
-			{
-				row++;
-
-				if (row > status_line)
-				{
-					break;
-				}
-			}
+		ed_off st;
+		long n;
+		char *b=ed_span(p,&st,&n);
+		char *q;
 
-		}
+		if ((st+n) > e) n=(long)(e-st);
 
-		if (row<status_line) 
-		{
-			crsr_row=row; 
-			crsr_col=col;
+#ifdef JOB_CANCEL
+		if ((st+n) > (p+JOB_SPAN)) n=(long)(p+JOB_SPAN-st);
 
-			break;
-		} 
-		else 
+		if (jb_step(p,e))
 		{
-			if (row==status_line) 
-			{
-#ifdef SCROLL_RGN
-				scrol_up();
-#else
-				plot(status_line,0);
-				clear_line();
-				plot(menu_line,0);
-				clear_line();
-#ifdef PLOT_CTRL
-				plot(menu_line,0);								 /* this will get on the last line */
-#endif
-				co(nl);
+			return -1;
+		}
 #endif
-				crsr_row=row=last_text;
-				crsr_col=col;
 
-				p=page_start;
-				i=ed_pos()-page_start;
-				col=0;
-				while (i--) 
-				{
-					int c=ed_at(p++);
-					page_start++;
-					col=next_col(col,c);
-					if (!col) 
-					{
-						i=0;
-					}
-				}
+		q=find_first(b+(p-st),b+n,c0,c1);
 
-				{
-					long l=ed_pos();
-					long m=sl_this(l);
+		if (!q)
+		{
+			p=st+n;
+			continue;
+		}
 
-					paint_text(m-l);
-				}
-				show_bottom(0);
-				/*		show_status();*/
+		p=st+(q-b);
 
-				break;
-			} 
-			else 
-			{
-				repage();
-			}
+		if (find_at(p,len)) 
+		{
+			return p;
 		}
+
+		p++;
 	}
+
+	return -1;
 }
 
-static void move_up(void)
+static ed_off find_fwd(ed_off p,long *len)
 {
-	long i;
-	long p;
-	int c2=0;
-
-/*	if (!crsr_row) 
+	/* where the next match at or after p starts, or -1,
+		*len is the length of the string or the match */
+	if (find_regex)
 	{
-		if (!page_start) return;
-		repage();
-		if (!crsr_row) return;
+		ed_off k=re_find(p,len);
+
+		while (find_word && (k >= 0) && !word_ok(k,*len))
+		{
+			k=re_find(k+1,len);
+		}
+
+		return k;
 	}
-*/
-/*	crsr_row--;*/
 
-	p=ed_pos();
-	i=sl_this(p);
-	i=prev_log(i);
-	col=col_at(p);
+#ifdef FIND_INDEX
+	if (mx_full())
+	{
+		return mx_next(p,ed_len()-*len+1);
+	}
+#endif
 
-	while (i < p)
+#ifdef FIND_PARALLEL
+	if ((ed_len()-p-*len) > (FIND_CHUNK*2))
 	{
-		c2=next_col(c2,ed_at(i));
-		if (!c2) 
-		{
-			break;
-		}
-		if (c2 > col)
+		ed_off k;
+
+		if (!find_par(p,1,&k,NULL,NULL))
 		{
-			break;
+			return k;
 		}
-		i++;
 	}
+#endif
 
-	i=i-p;
-
-	ed_move(i);
-	if (sel_on) paint_text(-i);
+	return find_seq(p,*len);
 }
 
-static void move_end(void)
+static ed_off find_back(ed_off p,long *len)
 {
-	long p=ed_pos();
-	long i=ed_len()-p;
-	long j=0;
+	/* where the closest match before p starts, or -1 */
+	if (find_regex)
+	{
+		ed_off k=re_rfind(p,len);
 
-	while (i--) 
+		while (find_word && (k >= 0) && !word_ok(k,*len))
+		{
+			k=(k+*len) ? re_rfind(k+*len-1,len) : -1;
+		}
+
+		return k;
+	}
+
+#ifdef FIND_INDEX
+	if (mx_full())
 	{
-		if (ed_at(p++)==nl) i=0; 
-		else j++;
+		long i=mx_rank(p-*len);
+
+		return i ? mx_get(i-1) : -1;
 	}
+#endif
 
-	ed_move(j);
+	if (*len <= p)
+	{
+#ifdef JOB_CANCEL
+		ed_off s=p-*len;
+#endif
 
-	if (sel_on) paint_text(-j);
-}
+		p-=*len;
 
-static void move_home(void)
-{
-	long j=sl_this(ed_pos());
-	long k=ed_pos()-j;
+		while (p--) 
+		{
+#ifdef JOB_CANCEL
+			if (jb_step(s-p,s))
+			{
+				break;
+			}
+#endif
+			if (find_at(p,*len)) 
+			{
+				return p;
+			}
+		}
+	}
 
-	ed_move(-k);
-	if (sel_on) paint_text(k);
+	return -1;
 }
 
-static void move_down(void)
+static ed_off find_nth(ed_off p,ed_off lim,long *len,ed_off *count)
 {
-	long p=ed_pos();
-	long i=ed_len()-p;
-	long j=0;
+	/* the lim'th match going forward from p, or the last one if there
+		are fewer, without moving or painting in between */
+	ed_off k=-1,c=0;
+	long l=*len;
 
-	row=crsr_row; 
-	col=crsr_col;
-	crsr_row++;
+#ifdef FIND_PARALLEL
+	int par=(!find_regex) && ((ed_len()-p-l) > (FIND_CHUNK*2));
 
-	while (i--) 
+#	ifdef FIND_INDEX
+	if (mx_full())
 	{
-		int c=ed_at(p++);
-
-		col=next_col(col,c);
+		/* stepping through the index is quicker */
+		par=0;
+	}
+#	endif
 
-		if (!col)
-		{
-			row++;
-		}
+	if (par && !find_par(p,lim,&k,&c,NULL))
+	{
+		if (count) *count=c;
 
-		if (crsr_row < row) 
-		{
-			break;
-		}
+		return k;
+	}
+#endif
 
-		j++;
+	while (c < lim)
+	{
+		long i=*len;
+		ed_off q=find_fwd(p,&i);
 
-		if ((crsr_row==row) & (col>=crsr_col)) 
+		if (q < 0)
 		{
 			break;
 		}
+
+		k=q;
+		l=i;
+		c++;
+		p=q+i;
 	}
 
-	ed_move(j);
-	if (sel_on) paint_text(-j);
+	*len=l;
+
+	if (count) *count=c;
+
+	return k;
 }
 
-static void flip_up(void)
+static ed_off ed_eol(ed_off p)
 {
-	long pos=ed_pos();
-	long l=sl_this(pos);
-	int k=total_lines-5;
-	long d;
-
-	while (k--)
+	/* where the line p is on ends */
+	while (p < ed_len())
 	{
-		if (!l) break;
+		ed_off st;
+		long n;
+		char *b=ed_span(p,&st,&n);
+		char *q=memchr(b+(p-st),nl,n-(long)(p-st));
 
-		l=prev_log(l);
+		if (q)
+		{
+			return st+(q-b);
+		}
+
+		p=st+n;
 	}
 
-	d=l-pos;
-	ed_move(d);
-	if (sel_on) paint_text(-d);
+	return p;
 }
 
-static void flip_down(void)
+static ed_off ed_bol(ed_off p,ed_off k)
 {
-	long p=ed_pos();
-	int j=total_lines-5;
-	long i=ed_len()-p;
-	int col=0;
-
-	p=sl_this(p);
+	/* where the line k is on starts, p being the start of a line
+		at or before it */
+	ed_off s=p;
 
-	while (i--) 
+	while (p < k)
 	{
-		int ch=ed_at(p++);
-		col=next_col(col,ch);
-		if (!col)
+		ed_off st;
+		long n;
+		char *b=ed_span(p,&st,&n);
+		char *q;
+
+		if ((st+n) > k) n=(long)(k-st);
+
+		q=memchr(b+(p-st),nl,n-(long)(p-st));
+
+		if (q)
 		{
-			j--;
+			p=st+(q-b)+1;
+			s=p;
 		}
-		if (j < 0)
+		else
 		{
-			i=0;
+			p=st+n;
 		}
 	}
 
-	p-=ed_pos();
-
-	ed_move(p);
-	if (sel_on) paint_text(-p);
+	return s;
 }
 
-static int cur_key(int i)
+static ed_off find_next(ed_off p,long *len)
 {
-	switch (i) 
+	/* find_fwd for going through every match in turn, without
+		starting the workers for each one */
+#ifdef FIND_INDEX
+	if (mx_full())
 	{
-	case ctrl_w:
-		ed_tzap();
-		cls(); 
-		menu_erased=1;
-		repage(); 
-		break;
-	case page_up:
-		if (ed_pos())
-		{
-			flip_up(); 
-		}
-		break;
-	case page_down: 
-		flip_down(); 
-		break;
-	case 8:
-	case key_del:
-	case 0x7f: 
-		delete_char(); 
-		break;
-	case key_left: 
-		move_left(); 
-		break;
-	case key_right: 
-		move_right(); 
-		break;
-	case key_up: 
-		move_up(); 
-		break;
-	case key_down: 
-		move_down(); 
-		break;
-	case key_start:
-		move_home();
-		break;
-	case key_end:
-		move_end();
-		break;
-	default: 
-		return 0;
+		return mx_next(p,ed_len()-*len+1);
 	}
-	find_cursor();
-	plot_cursor();
-	fflush(stdout);
-	return 1;   
+#endif
+
+	if (find_regex)
+	{
+		return find_fwd(p,len);
+	}
+
+	return find_seq(p,*len);
 }
 
-static void insert_text(void)
+static ed_off find_count(ed_off *lines)
 {
-	int c;
-	menu_erased=1;
-	show_status();
-	plot_cursor();
-	fflush(stdout);
-	while (escape!=(c=getkey())) 
+	/* the matches Find would step through from the top, and how
+		many lines they start on, one pass that only reads */
+	ed_off p=0,eol=-1,c=0;
+#ifdef FIND_PARALLEL
+	int par=(!find_regex) && (ed_len() > (FIND_CHUNK*2));
+
+#	ifdef FIND_INDEX
+	if (mx_full())
 	{
-		if (c==key_ins) break;
-		if (c==ctrl_z				 /*|(c==key_home)*/ ) break;
-		if (c==key_find) break;
-		if (c==key_sel) break;
+		/* stepping through the index is quicker */
+		par=0;
+	}
+#	endif
 
-#ifdef SQUASH_CR
-		if (c==13) c=-1;
+	/* no limit, there cannot be more matches than bytes */
+	if (par && !find_par(0,ed_len()+1,&p,&c,lines))
+	{
+		return c;
+	}
 #endif
 
-		if (c==-1) 
+	*lines=0;
+
+	while (forever)
+	{
+		long n=(long)strlen(f_string);
+		ed_off k=find_next(p,&n);
+
+		if (k < 0)
 		{
-			continue;
+			break;
 		}
 
-		if (!cur_key(c)) 
-		{
-			long p=ed_pos(),i;
-			int new_line=0;
+		c++;
 
-			if (c==13) c=nl;
+		if (k > eol)
+		{
+			(*lines)++;
+			eol=ed_eol(k);
+		}
 
+		p=k+(n ? n : 1);
+	}
 
-			if (mode=='i') 
-			{
-				ed_ins(c);
-				ed_move(-1L);
-			} 
-			else 
-			{
-				if (p != ed_len())
-				{
-					if (nl != ed_at(p))
-					{
-						ed_del(1L);
-					}
-				}
+	return c;
+}
 
-				ed_ins(c);
-				ed_move(-1L);
-			}
+#ifdef FIND_INDEX
+static int mx_sync(void)
+{
+	/* keep an index of the find string while highlighting literal
+		finds, returns 1 if what is underlined changed */
+	if ((opt_hilite[7]=='y') && !find_regex && f_string[0])
+	{
+		return mx_set(f_string);
+	}
 
-			if (c==nl) new_line=1;
+	if (mx.at)
+	{
+		mx_free();
+		return 1;
+	}
 
-			row=crsr_row; 
-			col=crsr_col;
-			i=ed_len()-p;
+	return 0;
+}
+#endif
 
-			while (i--) 
-			{
-				c=ed_at(p++);
+static void find_incr(long n)
+{
+	/* the first n bytes of the find string were typed, a longer
+		prefix can only be found at or beyond where the shorter one
+		was, so it is looked for from there and each result is kept
+		for when the string is backed over */
+	long l=n;
 
-				if (c==nl) break;
+	if (n > fi.n)
+	{
+		ed_off q=fi.at[n-1];
+		ed_off k=-1;
 
-				col=next_col(col,c);
+#ifdef JOB_CANCEL
+		jb_start("searching");
+#endif
 
-				if (!col)
+		if (q >= 0)
+		{
+			if (last_cmd=='-')
+			{
+				if ((n > 1) && (q < (fi.at[0]-n)) && match_string(q,f_string,n))
 				{
-					i=0;
-					new_line=1;
+					k=q;
+				}
+				else
+				{
+					k=find_back((n > 1) ? q+n : q,&l);
 				}
 			}
-
-			row=crsr_row; 
-			col=crsr_col;
-			plot_cursor();
-			if (new_line) 
-			{
-				/*	clear_end();*/
-				show_bottom(2);
-				/*	show_status();*/
-			} 
-			else 
+			else
 			{
-				long j=0;
-				p=ed_pos();
-				i=ed_len()-p;
-				while (i--) 
+				if ((n > 1) && (q <= (ed_len()-n)) && match_string(q,f_string,n))
 				{
-					if (ed_at(p++)==nl)
-					{
-						i=0;
-					}
-					else
-					{
-						j++;
-					}
+					k=q;
+				}
+				else
+				{
+					k=find_fwd((n > 1) ? q+1 : q,&l);
 				}
-				show_text(ed_pos(),j,1+crsr_row);
-				clear_line();
 			}
-			ed_move(1L);
-			find_cursor();
-			plot_cursor();
-			fflush(stdout);
-		}     	
-	}
-}
+		}
 
-static void save_select(char *file)
-{
-	FILE *fptr;
-	unsigned long i;
-	long p=ed_pos();
+#ifdef JOB_CANCEL
+		if (jb_end())
+		{
+			/* ESC stopped it, search when the string is done */
+			fi.on=0;
+			k=-1;
+		}
+#endif
 
-	if ((file==NULL) || !file[0]) return;
+		fi.at[n]=k;
+	}
 
-	if (sel_pos==ed_pos()) return;
+	fi.n=n;
 
-	if (sel_pos > ed_pos()) 
-	{
-		i=sel_pos-p;
-	} 
-	else 
+	if (sel_on)
 	{
-		i=p-sel_pos;
-		p=sel_pos;
+		sel_on=0;
+		paint_text(sel_pos-ed_pos());
 	}
 
-#ifdef _WIN32
-	if (file == clip_name)
+	if ((!n) || (!fi.on) || (fi.at[n] < 0))
 	{
-		clipboard_write(ed_at, p, i);
-
-		return;
+		ed_move(fi.at[0]-ed_pos());
+	}
+	else if (last_cmd=='-')
+	{
+		ed_move(fi.at[n]-ed_pos());
+		sel_on=1;
+		sel_pos=ed_pos()+n;
+		paint_text(sel_pos-ed_pos());
+	}
+	else
+	{
+		ed_move(fi.at[n]+n-ed_pos());
+		sel_on=1;
+		sel_pos=ed_pos()-n;
+		paint_text(sel_pos-ed_pos());
 	}
+
+	find_cursor();
+
+	/* the screen may have moved under the prompt */
+	plot(menu_line,0);
+	co_str(fi.label);
+	co_str(f_string);
+	co(0x22);
+	clear_line();
+	plot(menu_line,tty_col-1);
+}
+
+void do_find(int m)
+{
+	char *q;
+	long i;
+	ed_off k,f;
+	int incr=0;
+#ifdef FIND_INDEX
+	int fresh=0;
 #endif
 
-	fptr=fopen(file,"w");
+	f=0;
 
-#if defined(TEMP_FP) && !defined(_WIN32)
-	if ((fptr == NULL) && (file == clip_name))
+	if (m=='a') 
 	{
-		if (clip_fp)
+		char *p=f_string;
+		i=0;
+		while (*p++) i++;
+	} 
+	else 
+	{
+		last_cmd=m;
+
+		plot(menu_line,0);
+
+		switch (last_cmd) 
 		{
-			fclose(clip_fp);
+		case '-':	
+			fi.label="-find \042";	
+			break;
+		case 'f':	
+			fi.label="Find \042";	
+			break;
+		case 'r':	
+			fi.label="Replace \042";	
+			break;
+		case '?':	
+			fi.label="?replace \042"; 
+			break;
 		}
-		clip_fp = tmpfile();
-		fptr = clip_fp;
+
+		co_str(fi.label);
+
+		/* plain finds look as the string is typed */
+		fi.on=((m=='f') | (m=='-')) && !find_regex && !find_word && !again;
+		fi.n=0;
+		fi.at[0]=ed_pos();
+
+		i=get_text_input(f_string);
+
+		incr=fi.on && i && (fi.n==i);
+		fi.on=0;
 	}
-#endif /* TEMP_FP && !_WIN32 */
 
-	if (fptr) 
+	if (i) 
 	{
-		while (i--) 
+		if ((m=='r') | (m=='?'))
 		{
-			putc(ed_at(p),fptr);
-			p++;
+			int j;
+			co_str("\042 with \042");
+			j=tty_col;
+			co(0x22);
+			clear_line();
+			plot(menu_line,j);
+			fflush(stdout);
+
+			get_text_input(r_string);
 		}
 
-#if defined(TEMP_FP) && !defined(_WIN32)
-		if (fptr != clip_fp)
-#endif /* TEMP_FP && !_WIN32 */
+		if (find_regex && re_compile(f_string))
 		{
-			fclose(fptr);
+			plot(menu_line,0);
+			co_str(re_err);
+			clear_line();
+			plot_cursor();
+			fflush(stdout);
+			again=0;
+			return;
 		}
-	}
-}
 
-static char * enter_fname(char *fstr)
-{
-	int i=0,c,j;
-
-	menu_erased=1;
+#ifdef FIND_INDEX
+		fresh=mx_sync();
+#endif
 
-	plot(menu_line,0);
-	co_str(fstr);
-	c=tty_col;
-	clear_line();
-	plot(menu_line,c);
-	fflush(stdout);
+#ifdef JOB_CANCEL
+		jb_start("searching");
+#endif
 
-	while (nl!=(c=getkey())) 
-	{
-		if ((c==13)|(c==escape)) break;
-		if (c > 0)
+		if (last_cmd!='-') 
 		{
-			switch (c) 
+			if ((last_cmd=='f') && again)
 			{
-			case 8:
-			case key_del:
-			case 0x7f:
-				if (i) 
+				/* go straight to the last of the repeats */
+				k=find_nth(ed_pos(),again+1,&i,NULL);
+				again=0;
+			}
+			else if (incr)
+			{
+				k=fi.at[i];
+			}
+			else
+			{
+				k=find_fwd(ed_pos(),&i);
+			}
+
+			if (k >= 0)
+			{
+				f++;
+				k-=ed_pos();
+				switch (last_cmd) 
 				{
-					j=tty_col-1;
-					plot(menu_line,j);
-					clear_line();
-					i--;
+				case 'f':
+					ed_move(k+i);
+					sel_on=1;
+					sel_pos=ed_pos()-i;
+					paint_text(sel_pos-ed_pos());
+#ifdef FIND_INDEX
+					mx_cur=sel_pos;
+					menu_erased=1;
+#endif
+					break;
+				case '?':
+				case 'r':
+					{
+						ed_move(k);
+						ed_del(i);
+						sel_pos=ed_pos(); /* remember where deleted from */
+						q=r_string;
+						while (*q) 
+						{
+							ed_ins(*q++);
+						}
+						if (sel_pos != ed_pos())
+						{
+							sel_on=1;
+						}
+					/*	sel_pos=ed_pos()-i;*/
+					/*	paint_text(sel_pos-ed_pos());*/
+					/*	page_start=ed_pos()+1;*/
+						repage();
+					}
+					break;
 				}
-				break;
-			default:
-				get_fname[i++]=(char)c;
-				co(c);
+				find_cursor();
 			}
+		} 
 
-			fflush(stdout);
+		if (last_cmd=='-')
+		{
+			k=incr ? fi.at[i] : find_back(ed_pos(),&i);
+
+			if (k >= 0)
+			{
+				ed_move(k-ed_pos());
+				sel_on=1;
+				sel_pos=ed_pos()+i;
+				paint_text(sel_pos-ed_pos());
+				find_cursor();
+				f++;
+#ifdef FIND_INDEX
+				mx_cur=ed_pos();
+				menu_erased=1;
+#endif
+			}
 		}
+
+#ifdef JOB_CANCEL
+		jb_end();
+#endif
+	}
+#ifdef FIND_INDEX
+	if (fresh)
+	{
+		show_top();
+		show_bottom(1);
 	}
+#endif
+	if (menu_erased) show_status();
+	plot_cursor();
+	fflush(stdout);
+	if (!f) again=0;
+}
 
-	get_fname[i]=0;
-	if (!i) 
+static void do_count(void)
+{
+	plot(menu_line,0);
+	co_str("Count \042");
+
+	if (get_text_input(f_string))
 	{
-		co_str(clip_name);
-		return clip_name;
+		if (find_regex && re_compile(f_string))
+		{
+			plot(menu_line,0);
+			co_str(re_err);
+			clear_line();
+			plot_cursor();
+			fflush(stdout);
+			return;
+		}
+
+#ifdef JOB_CANCEL
+		jb_start("counting");
+#endif
+
+		count_n=find_count(&count_lines);
+
+#ifdef JOB_CANCEL
+		if (jb_end())
+		{
+			count_n=-1;
+		}
+#endif
+
+#ifdef FIND_INDEX
+		if (mx_sync())
+		{
+			show_top();
+			show_bottom(1);
+		}
+#endif
 	}
-	return get_fname;
+
+	show_status();
+	plot_cursor();
+	fflush(stdout);
 }
 
-static void do_get(char *file)
+static int nv_build(void)
 {
-	FILE *fptr = NULL;
-	long p=ed_pos();
-	long i=0;
-	struct stat s;
+	/* the lines with a match, in one pass */
+	ed_off p=0;
 
-	if ((file==NULL) || !file[0]) return;
+	nv.n=0;
 
-	if (file == clip_name)
+	while (p < ed_len())
 	{
-#ifdef _WIN32
-		long length = clipboard_length();
-
-		if (length < 1) return;
+		long n=(long)strlen(f_string);
+		ed_off k=find_next(p,&n);
 
-		if (ed_reserve(length))
+		if (k < 0)
 		{
-			return;
+			break;
 		}
 
-		fptr = clipboard_open();
-#else /* !_WIN32 */
-#	ifdef TEMP_FP
-		if (clip_fp)
+		if (nv.n==nv.size)
 		{
-			if (ed_reserve(ftell(clip_fp)))
+			long m=nv.size ? 2*nv.size : 1024;
+			ed_off *a=realloc(nv.at,m*sizeof(a[0]));
+
+			if (!a)
 			{
-				return;
+				return -1;
 			}
 
-			fptr = clip_fp;
-			rewind(fptr);			
+			nv.at=a;
+			nv.size=m;
 		}
-#	endif /* TEMP_FP */
-#endif /* !_WIN32 */
+
+		nv.at[nv.n++]=ed_bol(p,k);
+		p=ed_eol(k)+1;
 	}
 
-	if (!fptr)
+	return 0;
+}
+
+static void nv_show(void)
+{
+	/* one row per line, cut at the edge of the screen */
+	int r;
+
+	for (r=0; r < status_line; r++)
 	{
-		if (stat(file, &s))
+		row=r;
+		col=0;
+		plot(r,0);
+
+		if ((nv.top+r) < nv.n)
 		{
-			return;
-		}
+			ed_off q=nv.at[nv.top+r];
 
-		if (ed_reserve((long)s.st_size))
+			show_marks(q,ed_len()-q,r+1);
+
+			if (row==r) clear_line();
+		}
+		else
 		{
-			return;
+			clear_line();
 		}
-
-		fptr = fopen(file, "r");
 	}
+}
 
-	if (!fptr) return;
+static void do_narrow(void)
+{
+	ed_off p=sl_phys(ed_pos());
+	long lo,hi,top=-1;
+	int i,stop=0;
 
-	while (forever) 
+	plot(menu_line,0);
+	co_str("Narrow \042");
+
+	if (!get_text_input(f_string))
 	{
-		int c=getc(fptr);
-		if (c==EOF) break;
-		ed_ins(c);
+		show_status();
+		plot_cursor();
+		fflush(stdout);
+		return;
 	}
 
-#if defined(TEMP_FP) && !defined(_WIN32)
-	if (fptr != clip_fp)
-#endif /* TEMP_FP && !_WIN32 */
+	if (find_regex && re_compile(f_string))
 	{
-		fclose(fptr);
+		plot(menu_line,0);
+		co_str(re_err);
+		clear_line();
+		plot_cursor();
+		fflush(stdout);
+		return;
 	}
 
-	sel_pos=ed_pos();
-	i=sel_pos-p;
+#ifdef FIND_INDEX
+	mx_sync();
+#endif
 
-	ed_move(-i);
-	sel_on=1;
-	show_bottom(2);
-	ed_move(i);
-	sel_pos=ed_pos()-i;
-	find_cursor();
-	plot_cursor();
-}
+#ifdef JOB_CANCEL
+	jb_start("narrowing");
+#endif
 
-void do_clipboard(int c)
-{
-	switch(c) 
+	i=nv_build();
+
+#ifdef JOB_CANCEL
+	stop=jb_end();
+#endif
+
+	if (i || stop || !nv.n)
 	{
-	case 'b':
-		save_select(clip_name);
-		paint_text(sel_pos-ed_pos());
-		break;
-	case 'c':
-		save_select(enter_fname("Copy text to - "));
-		paint_text(sel_pos-ed_pos());
-		break;
-	case 'p':
-		save_select(enter_fname("Put text in - "));
-	case 'd':
-		if (c=='d') save_select(clip_name);
+		plot(menu_line,0);
+		co_str(stop ? "stopped" : (nv.n ? "out of memory" : "no lines match"));
+		clear_line();
+		plot_cursor();
+		fflush(stdout);
+		if (nv.at) free(nv.at);
+		memset(&nv,0,sizeof(nv));
+		return;
+	}
 
-		if (sel_pos==ed_pos()) return;
-		if (sel_pos<ed_pos()) 
+	/* start on the first line shown at or after the cursor */
+	lo=0;
+	hi=nv.n-1;
+
+	while (lo < hi)
+	{
+		long m=lo+((hi-lo)>>1);
+
+		if (nv.at[m] < p)
 		{
-			long d=ed_pos()-sel_pos;
-			ed_del(-d);
-			if (sel_pos < page_start) 
-			{
-				find_cursor();
-				plot_cursor();
-			} 
-			else 
-			{
-				find_cursor();
-				plot_cursor();
-				/*	clear_end();*/
-				show_bottom(1);
-			}
-		} 
-		else 
+			lo=m+1;
+		}
+		else
 		{
-			long d=sel_pos-ed_pos();
-			ed_del(d);
-			/* plot_cursor();*/
-			/*	clear_end();*/
-			show_bottom(1);
+			hi=m;
 		}
-		break;
-	default:
-		paint_text(sel_pos-ed_pos());
-		break;
 	}
-}
 
-static long get_text_input(char *f_string)
-{
-	int i=0;
-	int c,k;
+	nv.cur=lo;
+	nv.top=nv.cur-(status_line>>1);
+	mode='n';
+	menu_erased=1;
 
-	k=tty_col;
+	while (forever)
+	{
+		int c;
 
-	co_str(f_string);
-	co(0x22);
-	clear_line();
-	plot(menu_line,k);
+		if (nv.cur >= nv.n) nv.cur=nv.n-1;
+		if (nv.cur < 0) nv.cur=0;
+		if (nv.top > nv.cur) nv.top=nv.cur;
+		if (nv.top <= (nv.cur-status_line)) nv.top=nv.cur-status_line+1;
+		if (nv.top < 0) nv.top=0;
 
-	fflush(stdout);
+		if (top!=nv.top)
+		{
+			top=nv.top;
+			nv_show();
+		}
 
-	while (nl!=(c=getkey())) 
-	{
-		int j=0;
-		if ((c==13)|(c==escape)|(c==ctrl_z)|(c==key_home))
-			break;
-		if (c==key_ins) break;
+		crsr_row=(int)(nv.cur-nv.top);
+		crsr_col=0;
 
-		if (c > 0)
+		if (menu_erased) show_status();
+		plot_cursor();
+		fflush(stdout);
+
+		c=getkey();
+
+		if ((c >= '0') && (c <= '9'))
 		{
-			switch(c) 
+			c=get_again(c);
+			mode='n';
+			menu_erased=1;
+
+			if ((c!=nl) && (c!='j'))
 			{
-			case key_del:
-			case 8:
-			case 0x7f:
-				if (i) 
-				{
-					i--;
-					j=tty_col-1;
-				} else {
-					j=k;
-				}
-				clear_line();
-				plot(menu_line,j);
-				break;
-			default:
-				if (!i) {
-					clear_line();
-					plot(menu_line,k);
-					}
-				f_string[i++]=(char)c;
-				co(c);
+				again=0;
+				continue;
 			}
-			f_string[i]=0;
-			j=tty_col;
-			co(0x22);
-			plot(menu_line,j);
-			fflush(stdout);
-		}
-	}
-	i=0;
-	while (f_string[i]) i++;
-	plot(menu_line,k+i);
-	menu_erased=1;
 
-	return i;
-}
+			c='j';
+		}
 
-static int match_string(long p,char *q,long i)
-{
-	while (i--) 
-	{
-		if (ed_at(p++)!=(*q++)) 
+		switch (c)
 		{
-			return 0;
+		case key_up:
+			nv.cur--;
+			menu_erased=1;
+			break;
+		case key_down:
+			nv.cur++;
+			menu_erased=1;
+			break;
+		case page_up:
+			nv.cur-=total_lines-5;
+			menu_erased=1;
+			break;
+		case page_down:
+			nv.cur+=total_lines-5;
+			menu_erased=1;
+			break;
+		case 'j':
+			nv.cur=again ? again-1 : 0;
+			again=0;
+			menu_erased=1;
+			break;
+		case ctrl_w:
+			cls();
+			top=-1;
+			break;
+		case 13:
+		case escape:
+		case ctrl_z:
+		case key_ins:
+			/* back to everything, on the same line */
+			ed_move(nv.at[nv.cur]-ed_pos());
+			free(nv.at);
+			memset(&nv,0,sizeof(nv));
+			mode=0;
+			cls();
+			repage();
+			return;
 		}
 	}
-	return 1;
 }
 
-void do_find(int m)
+static void do_multi(int m)
 {
-	char *q;
-	long i,k,l,f;
-
-	f=0;
+	ed_off k=-1;
+	long i=0;
+	int w=-1;
 
-	if (m=='a') 
+	if (m!='a')
 	{
-		char *p=f_string;
-		i=0;
-		while (*p++) i++;
-	} 
-	else 
-	{
-		last_cmd=m;
+		char *err;
 
 		plot(menu_line,0);
+		co_str("Multi \042");
 
-		switch (last_cmd) 
+		if (!get_text_input(m_string))
 		{
-		case '-':	
-			co_str("-find \042");	
-			break;
-		case 'f':	
-			co_str("Find \042");	
-			break;
-		case 'r':	
-			co_str("Replace \042");	
-			break;
-		case '?':	
-			co_str("?replace \042"); 
-			break;
+			show_status();
+			plot_cursor();
+			fflush(stdout);
+			return;
+		}
+
+		err=ac_compile(m_string);
+
+		if (err)
+		{
+			plot(menu_line,0);
+			co_str(err);
+			clear_line();
+			plot_cursor();
+			fflush(stdout);
+			again=0;
+			return;
+		}
+	}
+
+	if (ac.states)
+	{
+#ifdef JOB_CANCEL
+		jb_start("searching");
+#endif
+		k=ac_find(ed_pos(),&i,&w);
+#ifdef JOB_CANCEL
+		if (jb_end())
+		{
+			k=-1;
 		}
+#endif
+	}
 
-		i=get_text_input(f_string);
+	if (k >= 0)
+	{
+		ed_move(k+i-ed_pos());
+		sel_on=1;
+		sel_pos=ed_pos()-i;
+		paint_text(sel_pos-ed_pos());
+		find_cursor();
+		ac_hit=w;
+		menu_erased=1;
+	}
+	else
+	{
+		again=0;
 	}
 
-	if (i) 
+	if (menu_erased) show_status();
+	plot_cursor();
+	fflush(stdout);
+}
+
+#ifdef UNDO_LOG
+static void do_undo(int c)
+{
+	/* u takes back the last command, ~ does it again */
+	long k=again ? again : 1;
+	struct ud_rec *r=NULL;
+
+	if (view_only)
 	{
-		if ((m=='r') | (m=='?'))
-		{
-			int j;
-			co_str("\042 with \042");
-			j=tty_col;
-			co(0x22);
-			clear_line();
-			plot(menu_line,j);
-			fflush(stdout);
+		return;
+	}
 
-			get_text_input(r_string);
-		}
+	ud.busy=1;
 
-		if (last_cmd!='-') 
+	while (k--)
+	{
+		long g;
+
+		if (c=='u')
 		{
-			long pp=ed_pos();
-			l=ed_len()-ed_pos();
+			if (!ud.top)
+			{
+				break;
+			}
 
-			if (i <= l)
+			g=ud.r[ud.top-1].grp;
+
+			while (ud.top && (ud.r[ud.top-1].grp==g))
 			{
-				l-=i;
-				k=0;
-				while (l--) 
+				r=ud.r+ud.top-1;
+
+				if (ud_swap(r))
 				{
-					if (match_string(pp,f_string,i)) 
-					{
-						f++;
-						l=0;
-						switch (last_cmd) 
-						{
-						case 'f':
-							ed_move(k+i);
-							sel_on=1;
-							sel_pos=ed_pos()-i;
-							paint_text(sel_pos-ed_pos());
-							break;
-						case '?':
-						case 'r':
-							{
-								ed_move(k);
-								ed_del(i);
-								sel_pos=ed_pos(); /* remember where deleted from */
-								q=r_string;
-								while (*q) 
-								{
-									ed_ins(*q++);
-								}
-								if (sel_pos != ed_pos())
-								{
-									sel_on=1;
-								}
-							/*	sel_pos=ed_pos()-i;*/
-							/*	paint_text(sel_pos-ed_pos());*/
-							/*	page_start=ed_pos()+1;*/
-								repage();
-							}
-							break;
-						}
-						find_cursor();
-					}
-					pp++;
-					k++;
+					/* the log file failed, it cannot be trusted now */
+					r=NULL;
+					k=0;
+					ud_free();
+					break;
 				}
-			}
-		} 
 
-		if (last_cmd=='-')
+				ud.top--;
+			}
+		}
+		else
 		{
-			long l=ed_pos();
-			if (i <= l)
+			if (ud.top==ud.n)
+			{
+				break;
+			}
+
+			g=ud.r[ud.top].grp;
+
+			while ((ud.top < ud.n) && (ud.r[ud.top].grp==g))
 			{
-				l-=i;
-				k=0;
-				while (l--) 
+				r=ud.r+ud.top;
+
+				if (ud_swap(r))
 				{
-					if (match_string(l,f_string,i)) 
-					{
-						ed_move(l-ed_pos());
-						sel_on=1;
-						sel_pos=ed_pos()+i;
-						paint_text(sel_pos-ed_pos());
-						find_cursor();
-						f++;
-						l=0;
-					}
-					k--;
+					/* the log file failed, it cannot be trusted now */
+					r=NULL;
+					k=0;
+					ud_free();
+					break;
 				}
+
+				ud.top++;
 			}
 		}
 	}
-	if (menu_erased) show_status();
-	plot_cursor();
-	fflush(stdout);
-	if (!f) again=0;
+
+	ud.busy=0;
+
+	if (r)
+	{
+		sel_pos=r->at;
+		sel_on=(sel_pos!=ed_pos());
+	}
+
+	repage();
 }
+#endif
 
 static void do_block(void)
 {
@@ -3675,10 +10680,42 @@ static int get_again(int k)
 
 static void update(void)
 {
+	int i=1;
+
+#ifdef SAVE_THREAD
+	/* one save at a time */
+	sv_wait();
+#endif
 	show_size=2;
 	show_status();
 	plot_cursor();
-	write_file(filename);
+#ifdef DIRTY_SAVE
+	/* in place when little has changed */
+	i=dx_save();
+#endif
+
+	if (i > 0)
+	{
+#ifdef SAVE_THREAD
+		/* otherwise whole, while editing goes on */
+		i=sv_start() ? -1 : write_file(filename);
+#else
+		i=write_file(filename);
+#endif
+	}
+#ifdef DIRTY_SAVE
+	if (!i)
+	{
+		dx_init(filename);
+	}
+#endif
+#ifdef JOURNAL
+	if (!i)
+	{
+		/* the file has every edit now */
+		jn_end();
+	}
+#endif
 	show_status();
 	plot_cursor();
 }
@@ -3686,16 +10723,24 @@ static void update(void)
 static void my_atexit(void)
 {
 /*	fflush(stdout);*/
+#ifdef PASTE_WAIT
+	co_puts("\033[?2004l");
+	fflush(stdout);
+#endif
 	tty_reset(0);
 }
 
 static void do_jump(long l)
 {
-	long i=ed_len();
-	long p=0;
+	ed_off i=ed_len();
+	ed_off p=0;
 
 	if (l) l--;	/* so that we're zero based */
 
+#ifdef JOB_CANCEL
+	jb_start("jumping");
+#endif
+
 	while (i--)
 	{
 		if (!l)
@@ -3703,6 +10748,13 @@ static void do_jump(long l)
 			break;
 		}
 
+#ifdef JOB_CANCEL
+		if (jb_step(p,ed_len()))
+		{
+			break;
+		}
+#endif
+
 		if (ed_at(p++)==nl)
 		{
 			l--;
@@ -3711,6 +10763,14 @@ static void do_jump(long l)
 
 	p=p-ed_pos();
 
+#ifdef JOB_CANCEL
+	if (jb_end())
+	{
+		/* stay put */
+		p=0;
+	}
+#endif
+
 	ed_move(p);
 
 	find_cursor();
@@ -3749,6 +10809,9 @@ void do_shell(void)
 	}
 
 	tty_raw(0);
+#ifdef PASTE_WAIT
+	co_puts("\033[?2004h");	/* pastes come bracketed */
+#endif
 
 	/* incase the screen changed during the shell */
 
@@ -3768,6 +10831,10 @@ static int ed_init(void)
 		return 1;
 	}
 #endif
+	if (view_only)
+	{
+		return 0;
+	}
 #ifdef TEMP_FP
 	cur_file.t_fp=tmpfile();
 	if (!cur_file.t_fp)
@@ -3821,6 +10888,21 @@ static int ed_init(void)
 
 static void ed_clos(void)
 {
+#ifdef SAVE_THREAD
+	sv_wait();
+#endif
+#ifdef FOLLOW_FILE
+	follow_close();
+#endif
+#ifdef UNDO_LOG
+	ud_free();
+#endif
+#ifdef JOURNAL
+	jn_end();
+#endif
+#ifdef HAVE_MMAP
+	ed_unmap();
+#endif
 #ifdef TEMP_FP
 	if (cur_file.t_fp)
 	{
@@ -3850,8 +10932,57 @@ static void ed_clos(void)
 	}
 }
 
+static void do_options(void)
+{
+	mode='o';
+
+	while (forever) 
+	{
+		menu_erased=1;
+		show_status();
+		plot_cursor();
+		fflush(stdout);
+
+		switch (getkey()) 
+		{
+		case 'c':
+			find_nocase=!find_nocase;
+			opt_case[5]=find_nocase ? 'n' : 'y';
+			break;
+#ifdef FIND_INDEX
+		case 'h':
+			opt_hilite[7]=(opt_hilite[7]=='y') ? 'n' : 'y';
+			break;
+#endif
+		case 'r':
+			find_regex=!find_regex;
+			opt_regex[6]=find_regex ? 'y' : 'n';
+			break;
+		case 'w':
+			find_word=!find_word;
+			opt_word[5]=find_word ? 'y' : 'n';
+			break;
+		default:
+			mode=0;
+			menu_erased=1;
+#ifdef FIND_INDEX
+			if (mx_sync())
+			{
+				show_top();
+				show_bottom(1);
+			}
+#endif
+			show_status();
+			plot_cursor();
+			return;
+		}
+	}
+}
+
 static int quit(void)
 {
+	int k;
+
 	mode='q';
 	menu_erased=1;
 	show_status();
@@ -3860,14 +10991,14 @@ static int quit(void)
 
 	while (forever) 
 	{
-		switch (getkey()) 
+		switch (k=getkey()) 
 		{
 		case 'e':
-			update();
+			if (!view_only) update();
 		case 'a':
 			return 0;
 		case 'u':
-			update();
+			if (!view_only) update();
 			return 1;
 		case key_ins:
 		case escape:
@@ -3878,9 +11009,16 @@ static int quit(void)
 			{
 				char *fname=enter_fname("Write file - ");
 				menu_erased=1;
-				if (fname && fname[0] && (fname != clip_name))
+				if (fname && fname[0] && (fname != clip_name)
+					&& !(view_only && filename && !strcmp(fname,filename)))
 				{
+#ifdef JOB_CANCEL
+					jb_start("writing");
+					write_file(fname);
+					jb_end();
+#else
 					write_file(fname);
+#endif
 				}
 				show_status();
 				plot_cursor();
@@ -3888,13 +11026,16 @@ static int quit(void)
 			}
 			break;
 		case 'i':
+		case 'v':
 			{
 				FILE *fp=NULL;
-				char *fname=enter_fname("Edit file - ");
+				char *fname=enter_fname((k=='v') ? "View file - " : "Edit file - ");
 				menu_erased=1;
-				if (fname && fname[0] && (fname != clip_name) && !ed_check(fname,&fp))
+				if (fname && fname[0] && (fname != clip_name) && !ed_check(fname,&fp)
+					&& (fp || (k!='v')))
 				{
 					ed_clos();
+					view_only=(k=='v');
 					ed_init();
 					init(fname,fp);
 					return 1;
@@ -3918,6 +11059,8 @@ int main(int argc,char **argv)
 	int editing=0;
 	char *fn=NULL;
 	FILE *fp=NULL;
+	int argi=1;
+	int recover=0;
 #ifdef HAVE_PWD_H
 	struct passwd *pw=getpwuid(getuid());
 
@@ -3927,21 +11070,72 @@ int main(int argc,char **argv)
 	}
 #endif
 
-	if (argc > 2)
+	while ((argc > argi) && (argv[argi][0]=='-') && argv[argi][1] && !argv[argi][2])
+	{
+		switch (argv[argi][1])
+		{
+		case 'v':
+			view_only=1;
+			break;
+#ifdef FOLLOW_FILE
+		case 'f':
+			follow=1;
+			break;
+#endif
+#ifdef JOURNAL
+		case 'r':
+			recover=1;
+			break;
+#endif
+		default:
+			argc=0;
+			break;
+		}
+
+		argi++;
+	}
+
+	if ((argc > (argi+1)) || (argc < argi) || (view_only && (argc == argi)) || (recover && (view_only || (argc == argi))))
 	{
-		fprintf(stderr,"usage:\n\t%s [file]\n",argv[0]);
+#ifdef JOURNAL
+		fprintf(stderr,"usage:\n\t%s [-f] [-r] [-v] [file]\n",argv[0]);
+#else
+		fprintf(stderr,"usage:\n\t%s [-f] [-v] [file]\n",argv[0]);
+#endif
 		return 1;
 	}
 
-	if (argc > 1)
+	if (argc > argi)
 	{
-		fn=argv[1];
+		fn=argv[argi];
+
+#ifdef DIRTY_SAVE
+		if (!view_only)
+		{
+			dx_redo(fn);
+		}
+#endif
 
-		if (ed_check(fn,&fp))
+		if (ed_check(fn,&fp) || (view_only && !fp))
 		{
 			perror(fn);
 			return 1;
 		}
+
+#ifdef JOURNAL
+		if (!view_only)
+		{
+			int i=jn_check(fn);
+
+			if (recover ? (i!=1) : i)
+			{
+				fprintf(stderr,"%s: %s\n",fn,
+					recover ? (i ? "the recovery journal is for another version of it" : "nothing to recover")
+						: "there are edits to recover, use -r or remove the .aej file");
+				return 1;
+			}
+		}
+#endif
 	}
 
 	{
@@ -3954,6 +11148,17 @@ int main(int argc,char **argv)
 		if (p && p[0]) total_lines=atoi(p);
 	}
 
+#ifdef ESC_DELAY
+	{
+		char *p=getenv("ESCDELAY");
+		if (p && p[0]) esc_delay=atoi(p);
+	}
+#endif
+
+#ifdef EVENT_PIPE
+	ev_init();
+#endif
+
 #ifdef SIGWINCH
 	signal(SIGWINCH,winch);	/* want this to notify of screen changes */
 #ifdef SIGTTIN
@@ -3969,6 +11174,10 @@ int main(int argc,char **argv)
 
 	atexit(my_atexit);
 
+#ifdef PASTE_WAIT
+	co_puts("\033[?2004h");	/* pastes come bracketed */
+#endif
+
 	if (tty_sz(0))
 	{
 		fprintf(stderr, "Failed to determine terminal size");
@@ -3993,11 +11202,27 @@ int main(int argc,char **argv)
 	{
 		fp=NULL;
 		editing=1;
+
+#ifdef JOURNAL
+		if (recover)
+		{
+			jn_replay();
+			repage();
+		}
+#endif
 	}
 
 	while (editing) 
 	{
 		int c;
+#ifdef JOB_CANCEL
+		if (again && jb_keys(0))
+		{
+			/* ESC stops the repeats */
+			again=0;
+			jb.stop=0;
+		}
+#endif
 		if (again) 
 		{
 			c='a';
@@ -4005,7 +11230,20 @@ int main(int argc,char **argv)
 		} 
 		else 
 		{
+#ifdef FOLLOW_FILE
+			follow_key=(follow_fd!=-1);
+#endif
 			c=getkey();
+#ifdef UNDO_LOG
+			ud.grp++;
+#endif
+#ifdef PASTE_WAIT
+			if (pasting)
+			{
+				/* text rather than commands */
+				do_paste();
+			}
+#endif
 		}
 
 		if (sel_on) 
@@ -4014,6 +11252,26 @@ int main(int argc,char **argv)
 			paint_text(sel_pos-ed_pos());
 		}
 
+#ifdef FIND_INDEX
+		if (mx_cur >= 0)
+		{
+			/* the count goes with the selection */
+			mx_cur=-1;
+			menu_erased=1;
+			show_status();
+			plot_cursor();
+		}
+#endif
+
+		if ((ac_hit >= 0) || (count_n >= 0))
+		{
+			ac_hit=-1;
+			count_n=-1;
+			menu_erased=1;
+			show_status();
+			plot_cursor();
+		}
+
 		if ((c>='0') & (c<='9')) 
 		{
 			c=get_again(c);
@@ -4068,10 +11326,23 @@ int main(int argc,char **argv)
 		case 'r':
 		case '?':
 			if (again) again--;
+			if (view_only && ((c=='r') | (c=='?'))) break;
 			last_cmd=(char)c;
 			mode=c;
 			do_find(c);
 			break;
+		case 'c':
+			do_count();
+			break;
+		case 'n':
+			do_narrow();
+			break;
+		case 'm':
+			if (again) again--;
+			last_cmd=(char)c;
+			mode=c;
+			do_multi(c);
+			break;
 		case 'l':
 			show_size=1;
 			show_status();
@@ -4082,10 +11353,14 @@ int main(int argc,char **argv)
 			{
 			case '?':
 			case 'r':
+				if (view_only) break;
 			case '-':
 			case 'f':
 				do_find('a');
 				break;
+			case 'm':
+				do_multi('a');
+				break;
 			default:
 				again=0;
 				break;
@@ -4103,6 +11378,60 @@ int main(int argc,char **argv)
 		case 's':
 			do_shell();
 			break;
+		case 'o':
+			do_options();
+			break;
+#ifdef UNDO_LOG
+		case 'u':
+		case '~':
+			do_undo(c);
+			again=0;
+			break;
+#endif
+#ifdef FOLLOW_FILE
+		case key_grow:
+			{
+				/* keep following the end if the cursor was there */
+				int tail=(ed_pos()==ed_len());
+				int i=ed_follow();
+
+				if (i < 0)
+				{
+					/* view the file that took its place */
+					FILE *fp=NULL;
+					char *fn=strjoin("",filename,NULL);
+
+					if (fn && !ed_check(fn,&fp) && fp)
+					{
+						ed_clos();
+						ed_init();
+						init(fn,fp);
+					}
+					else
+					{
+						follow_close();
+					}
+
+					if (fn) free(fn);
+				}
+				else if (i)
+				{
+					if (tail)
+					{
+						/* paint what came in below the old end, then go to the new one */
+						show_bottom(1);
+						ed_move(ed_len()-ed_pos());
+						find_cursor();
+					}
+					else
+					{
+						show_bottom(1);
+					}
+					plot_cursor();
+				}
+			}
+			break;
+#endif
 		case 'v':
 			c=ctrl_w;									/* fall through */
 		default:
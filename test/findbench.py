@@ -0,0 +1,99 @@
+#
+#  Copyright 2021, Roger Brown
+#
+#  This file is part of RHB aedit.
+#
+#  This program is free software: you can redistribute it and/or modify it
+#  under the terms of the GNU General Public License as published by the
+#  Free Software Foundation, either version 3 of the License, or (at your
+#  option) any later version.
+#
+#  This program is distributed in the hope that it will be useful, but WITHOUT
+#  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+#  more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>
+#
+
+# times Count over the same text with plain strings and with regular
+# expressions that find the same thing, and checks the counts against
+# python's own re, the text is made from a fixed seed so runs compare
+#
+#	python3 test/findbench.py [aedit] [megabytes] [runs]
+
+import os, random, re, shutil, sys, tempfile
+from term import Aedit
+
+exe = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else 'aedit')
+size = int(sys.argv[2] if len(sys.argv) > 2 else 64) << 20
+runs = int(sys.argv[3] if len(sys.argv) > 3 else 3)
+
+# the string, then an expression for the same matches
+PAIRS = [
+	('needle', 'needle'),
+	('needle', 'ne+dle'),
+	('error 404', 'error 40[4]'),
+	('qzx', 'q[z]x'),
+	('the ', '(the|THE) '),
+]
+
+WORDS = ('the quick brown fox jumps over lazy dog error 404 200 '
+	'ok warn needle haystack alpha beta gamma delta').split()
+
+def text(n):
+	r = random.Random(1989)
+	out = []
+	got = 0
+	while got < n:
+		line = ' '.join(r.choice(WORDS) for i in range(r.randint(3, 14))) + '\n'
+		out.append(line)
+		got += len(line)
+	return ''.join(out).encode()
+
+def count(fn, pat, regex):
+	# seconds from RETURN to the count showing, and the count
+	a = Aedit(exe, ['-v', fn], rows=24, cols=132)
+	a.wait('Again', 600)
+	if regex:
+		a.send('or ')
+		a.wait('Regex=y', 10)
+	a.send('c' + pat)
+	a.send('\r')
+	t = a.wait(r'(\d+) match(es)? on (\d+) lines?', 600)
+	m = re.search(rb'(\d+) match(es)? on (\d+) lines?', a.out[a.mark:])
+	a.send('qa')
+	a.close()
+	return t, int(m.group(1)), int(m.group(3))
+
+def main():
+	work = tempfile.mkdtemp(prefix='aedit')
+	try:
+		fn = os.path.join(work, 'bench.txt')
+		data = text(size)
+		with open(fn, 'wb') as f:
+			f.write(data)
+		lines = data.split(b'\n')
+		bad = 0
+		print('%d bytes, %d lines, best of %d' % (len(data), len(lines) - 1, runs))
+		print('%-12s %-12s %10s %10s %8s %8s' % ('string', 'regex', 'matches', 'lines', 'plain s', 'regex s'))
+		for s, x in PAIRS:
+			want = len(re.findall(re.escape(s).encode(), data))
+			wantl = sum(1 for l in lines if s.encode() in l)
+			best = []
+			for pat, regex in ((s, 0), (x, 1)):
+				b = None
+				for i in range(runs):
+					t, n, l = count(fn, pat, regex)
+					if (n, l) != (want, wantl):
+						print('mismatch %r: %d on %d, want %d on %d' % (pat, n, l, want, wantl))
+						bad += 1
+					b = t if b is None else min(b, t)
+				best.append(b)
+			print('%-12s %-12s %10d %10d %8.3f %8.3f' % (s, x, want, wantl, best[0], best[1]))
+		return 1 if bad else 0
+	finally:
+		shutil.rmtree(work, ignore_errors=True)
+
+sys.exit(main())
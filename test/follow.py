@@ -0,0 +1,111 @@
+#
+#  Copyright 2021, Roger Brown
+#
+#  This file is part of RHB aedit.
+#
+#  This program is free software: you can redistribute it and/or modify it
+#  under the terms of the GNU General Public License as published by the
+#  Free Software Foundation, either version 3 of the License, or (at your
+#  option) any later version.
+#
+#  This program is distributed in the hope that it will be useful, but WITHOUT
+#  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+#  more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>
+#
+
+# follows a log with -f while it is appended to, rotated and cut short,
+# editing it and viewing it, then checks what a Write of it gives
+#
+#	python3 test/follow.py [aedit]
+
+import os, shutil, sys, tempfile, time
+from term import Aedit
+
+exe = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else 'aedit')
+
+PGDN = '\x1b[6~'
+
+def check(what, ok):
+	if not ok:
+		print('follow: failed, ' + what)
+		sys.exit(1)
+
+def put(fn, text, mode='a'):
+	with open(fn, mode) as f:
+		f.write(text)
+
+def cut(fn, text):
+	# in place, as copytruncate leaves a log
+	with open(fn, 'r+') as f:
+		f.truncate(0)
+		f.write(text)
+
+def seen(a, pattern):
+	# for what the editor does by itself, not for a key
+	a.mark = len(a.out)
+	a.sent = time.time()
+	a.wait(pattern, 10)
+
+def write(a, fn):
+	a.send('qw' + fn + '\r')
+	a.send('qa')
+	st = a.close()
+	check('exit status %r' % st, st == 0)
+	with open(fn) as f:
+		return f.read()
+
+work = tempfile.mkdtemp(prefix='aedit')
+
+try:
+	log = os.path.join(work, 'log.txt')
+	out = os.path.join(work, 'out.txt')
+
+	# editing, the document keeps what each file had
+	put(log, 'one\n', 'w')
+	a = Aedit(exe, ['-f', log])
+	a.wait('one', 10)
+	put(log, 'two\n')
+	seen(a, 'two')
+	os.rename(log, log + '.1')
+	put(log, 'three\n', 'w')
+	seen(a, 'three')
+	cut(log, '')
+	time.sleep(1)
+	put(log, 'four\n')
+	seen(a, 'four')
+	check('edit', write(a, out) == 'one\ntwo\nthree\nfour\n')
+	os.remove(log + '.1')
+	os.remove(out)
+
+	# viewing, the document is whichever file now has the name
+	put(log, 'old\n', 'w')
+	a = Aedit(exe, ['-v', '-f', log])
+	a.wait('old', 10)
+	os.rename(log, log + '.1')
+	put(log, 'new\n', 'w')
+	seen(a, 'new')
+	check('view rotated', write(a, out) == 'new\n')
+	os.remove(out)
+
+	# viewing a big file that is cut short, paging past the new end
+	put(log, ''.join('line %06d\n' % i for i in range(100000)), 'w')
+	a = Aedit(exe, ['-v', '-f', log])
+	a.wait('line 000000', 10)
+	a.send('99999\n')
+	a.wait('line 099999', 10)
+	time.sleep(1)
+	cut(log, 'cut\n')
+	seen(a, 'cut')
+	a.send(PGDN * 4)
+	time.sleep(0.5)
+	put(log, 'more\n')
+	seen(a, 'more')
+	check('view cut', write(a, out) == 'cut\nmore\n')
+
+	print('follow: ok')
+finally:
+	shutil.rmtree(work, ignore_errors=True)
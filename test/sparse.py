@@ -0,0 +1,99 @@
+#
+#  Copyright 2021, Roger Brown
+#
+#  This file is part of RHB aedit.
+#
+#  This program is free software: you can redistribute it and/or modify it
+#  under the terms of the GNU General Public License as published by the
+#  Free Software Foundation, either version 3 of the License, or (at your
+#  option) any later version.
+#
+#  This program is distributed in the hope that it will be useful, but WITHOUT
+#  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+#  more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>
+#
+
+# edits, searches and saves a 6GB file, well past where 32 bit offsets
+# give out, made sparse so it takes little disk until it is saved
+#
+#	python3 test/sparse.py [aedit] [directory]
+#
+# skipped where the directory cannot hold a sparse file, or has not the
+# room for the editor's temp file and the saved copy
+
+import os, shutil, sys, tempfile
+from term import Aedit
+
+SIZE = 6 << 30
+STEP = 1 << 20
+
+exe = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else 'aedit')
+top = sys.argv[2] if len(sys.argv) > 2 else tempfile.gettempdir()
+
+def skip(why):
+	print('sparse: skipped, ' + why)
+	sys.exit(0)
+
+def check(what, ok):
+	if not ok:
+		print('sparse: failed, ' + what)
+		sys.exit(1)
+
+work = tempfile.mkdtemp(prefix='aedit', dir=top)
+
+try:
+	fn = os.path.join(work, 'big.txt')
+
+	with open(fn, 'wb') as f:
+		# a short line every megabyte, the rest holes
+		f.truncate(SIZE)
+		for o in range(0, SIZE, STEP):
+			f.seek(o)
+			f.write(b'\nline %d\n' % (o // STEP))
+		f.seek(SIZE // 2)
+		f.write(b'\nneedle in the middle\n')
+		f.seek(SIZE - 10)
+		f.write(b'last line\n')
+
+	st = os.stat(fn)
+
+	if not hasattr(st, 'st_blocks') or (st.st_blocks * 512) > (SIZE // 4):
+		skip('no sparse files in ' + top)
+
+	# the saved copy goes beside it, the editor's temp file in /tmp
+	tmp = tempfile.gettempdir()
+	both = os.stat(tmp).st_dev == st.st_dev
+
+	if (shutil.disk_usage(work).free < (SIZE + STEP)) or (shutil.disk_usage(tmp).free < ((SIZE + STEP) << both)):
+		skip('not room in ' + top)
+
+	a = Aedit(exe, [fn])
+	a.wait('line 0', 1200)
+
+	a.send('iX\x1a')
+	a.send('fneedle\r')
+	a.wait('(?s)Find "needle".*Again', 1200)
+
+	a.send('iY\x1a')
+	a.send('qu')
+	a.send('qa')
+	st = a.close(1800)
+	check('exit status %r' % st, st == 0)
+
+	check('size', os.path.getsize(fn) == SIZE + 2)
+
+	with open(fn, 'rb') as f:
+		check('start', f.read(9) == b'X\nline 0\n')
+		f.seek(SIZE // 2 + 1)
+		check('middle', f.read(23) in (b'\nYneedle in the middle\n', b'\nneedleY in the middle\n'))
+		f.seek(SIZE - 10 + 2)
+		check('end', f.read() == b'last line\n')
+
+	check('journal', not os.path.exists(fn + '.aej'))
+	print('sparse: ok')
+finally:
+	shutil.rmtree(work, ignore_errors=True)
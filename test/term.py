@@ -0,0 +1,90 @@
+#
+#  Copyright 2021, Roger Brown
+#
+#  This file is part of RHB aedit.
+#
+#  This program is free software: you can redistribute it and/or modify it
+#  under the terms of the GNU General Public License as published by the
+#  Free Software Foundation, either version 3 of the License, or (at your
+#  option) any later version.
+#
+#  This program is distributed in the hope that it will be useful, but WITHOUT
+#  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+#  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+#  more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>
+#
+
+# runs aedit on a pseudo terminal for the scripts in here, keys are
+# sent as they would be typed and the screen output is waited on
+
+import fcntl, os, pty, re, select, signal, struct, termios, time
+
+class Aedit:
+	def __init__(self, exe, args, env=None, rows=24, cols=80):
+		e = dict(os.environ)
+		e['TERM'] = 'xterm'
+		e.pop('COLUMNS', None)
+		e.pop('LINES', None)
+		if env:
+			e.update(env)
+		self.pid, self.fd = pty.fork()
+		if not self.pid:
+			try:
+				os.execve(exe, [exe] + args, e)
+			finally:
+				os._exit(127)
+		fcntl.ioctl(self.fd, termios.TIOCSWINSZ, struct.pack('HHHH', rows, cols, 0, 0))
+		self.out = b''
+		self.mark = 0
+		self.sent = self.seen = time.time()
+
+	def pump(self, t):
+		# wait up to t seconds for output, False once it has gone
+		r, _, _ = select.select([self.fd], [], [], t)
+		if r:
+			try:
+				d = os.read(self.fd, 65536)
+			except OSError:
+				d = b''
+			if not d:
+				return False
+			self.out += d
+			self.seen = time.time()
+		return True
+
+	def send(self, keys):
+		# from here on wait() only looks at what comes after
+		if isinstance(keys, str):
+			keys = keys.encode()
+		self.mark = len(self.out)
+		for k in keys:
+			self.pump(0.01)
+			os.write(self.fd, bytes([k]))
+			self.sent = time.time()
+
+	def wait(self, pattern, timeout):
+		# seconds from the last key sent until pattern showed
+		p = re.compile(pattern.encode() if isinstance(pattern, str) else pattern)
+		while not p.search(self.out, self.mark):
+			if (time.time() - self.sent) > timeout:
+				raise RuntimeError('no %r after %d seconds' % (p.pattern, timeout))
+			if not self.pump(0.05):
+				raise RuntimeError('aedit went while waiting for %r' % p.pattern)
+		return self.seen - self.sent
+
+	def close(self, timeout=60):
+		# the exit status once it has finished, killing it if it will not
+		end = time.time() + timeout
+		while time.time() < end:
+			p, st = os.waitpid(self.pid, os.WNOHANG)
+			if p:
+				os.close(self.fd)
+				return st
+			self.pump(0.1)
+		os.kill(self.pid, signal.SIGKILL)
+		os.waitpid(self.pid, 0)
+		os.close(self.fd)
+		return None
@@ -54,6 +54,6 @@ int tty_read(int,char *,int);
 
 int tty_winsize(int *cols,int *rows);
 
-void clipboard_write(int(*)(long), long, long);
+void clipboard_write(int(*)(__int64), __int64, __int64);
 FILE* clipboard_open(void);
 long clipboard_length(void);
@@ -533,7 +533,7 @@ int tty_winsize(int *cols,int *rows)
 	return -1;
 }
 
-void clipboard_write(int(* ed_at)(long), long pos, long len)
+void clipboard_write(int(* ed_at)(__int64), __int64 pos, __int64 len)
 {
 	BOOL bClipboard = OpenClipboard(NULL);
 
@@ -541,9 +541,9 @@ void clipboard_write(int(* ed_at)(long), long pos, long len)
 	{
 		__try
 		{
-			long lines = 0;
-			long pos2 = pos;
-			long len2 = len;
+			__int64 lines = 0;
+			__int64 pos2 = pos;
+			__int64 len2 = len;
 			char* p;
 			HGLOBAL hglbCopy;
 
@@ -555,7 +555,7 @@ void clipboard_write(int(* ed_at)(long), long pos, long len)
 				}
 			}
 
-			hglbCopy = GlobalAlloc(GMEM_MOVEABLE, 1 + len + lines);
+			hglbCopy = GlobalAlloc(GMEM_MOVEABLE, (SIZE_T)(1 + len + lines));
 
 			if (hglbCopy)
 			{